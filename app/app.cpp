@@ -3,6 +3,8 @@
 
 #include "Utils/Color.hpp"
 #include "Objects/Instances.hpp"
+#include "Objects/BVH.hpp"
+#include "Objects/SphereSet.hpp"
 #include "Objects/Camera.hpp"
 #include "Core/Renderer.hpp"
 
@@ -35,15 +37,14 @@ int main()
     world.add(std::make_shared<Rectangle<X, Z>>(0, 0, 555, 555, 555, white));
     world.add(std::make_shared<Rectangle<X, Y>>(0, 0, 555, 555, 555, white));
 
-    auto light = std::make_shared<Rectangle<X, Z>>(213, 227, 343, 332, 554, light_mat);
+    auto light = flip(std::make_shared<Rectangle<X, Z>>(213, 227, 343, 332, 554, light_mat));
     auto sphere = std::make_shared<Sphere>(Vec3{190, 90, 190}, 90, std::make_shared<Dielectric>(2.f));
 
-    world.add(flip(light));
+    world.add(light);
     world.add(sphere);
 
-    auto lights = std::make_shared<HittableList>();
-    lights->add(light);
-    lights->add(sphere);
+    HittableList lights {};
+    lights.add(light);
 
     // Create and place the boxes
     std::shared_ptr<Hittable> box1 = std::make_shared<Box>(Vec3{0, 0, 0}, Vec3{165, 330, 165}, metal);
@@ -57,10 +58,15 @@ int main()
     world.add(box1);
 //    world.add(box2);
 
-    world = HittableList{std::make_shared<BVHnode>(world)};
+    collapse_instances(world);
+    gather_spheres(world);
+    auto bvh = std::make_shared<BVHnode>(world);
+    bvh->report();
+    world = HittableList{std::make_shared<BVH8>(*bvh)};
 
     // Render the image
     Renderer r {Image{width, height}, world, samples_per_pixel, depth};
+    r.sampler = std::make_shared<ZSobolSampler>(samples_per_pixel, width, height);
     r.render(cam, lights);
 
     return 0;
@@ -0,0 +1,53 @@
+
+#include "Allocations.hpp"
+
+#include <new>
+
+#ifdef ILYA_COUNT_ALLOCATIONS
+
+// Each thread counts its own allocations, so that counting doesn't
+// need any synchronization, and so that a thread can tell how many
+// allocations a piece of its own work made without seeing the ones of
+// the other threads.
+static thread_local uint64_t allocations = 0;
+
+static void* allocate(std::size_t size, std::size_t alignment = 0)
+{
+    ++allocations;
+
+    size = std::max<std::size_t>(size, 1);
+    auto ptr = alignment ? std::aligned_alloc(alignment, (size + alignment - 1)/alignment*alignment)
+                         : std::malloc(size);
+    if(!ptr)
+        throw std::bad_alloc {};
+
+    return ptr;
+}
+
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new[](std::size_t size) { return allocate(size); }
+void* operator new(std::size_t size, std::align_val_t al) { return allocate(size, std::size_t(al)); }
+void* operator new[](std::size_t size, std::align_val_t al) { return allocate(size, std::size_t(al)); }
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+
+#endif
+
+namespace Ilya
+{
+    uint64_t allocation_count()
+    {
+#ifdef ILYA_COUNT_ALLOCATIONS
+        return allocations;
+#else
+        return 0;
+#endif
+    }
+}
\ No newline at end of file
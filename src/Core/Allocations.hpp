@@ -0,0 +1,13 @@
+
+#pragma once
+
+#include "Core.hpp"
+
+namespace Ilya
+{
+    /// Number of heap allocations made so far by the calling thread.
+    /// Allocations are only counted when building with the
+    /// `ILYA_COUNT_ALLOCATIONS` option, which replaces the global
+    /// `operator new`; otherwise, this always returns 0.
+    uint64_t allocation_count();
+}
\ No newline at end of file
@@ -41,4 +41,10 @@ namespace Ilya
 
         img.print("{} {} {}\n", (int)r, (int)g, (int)b);
     }
+
+    void Image::write(const std::vector<Color>& framebuffer)
+    {
+        for (const auto& color: framebuffer)
+            write(color);
+    }
 }
\ No newline at end of file
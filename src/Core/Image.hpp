@@ -16,6 +16,10 @@ namespace Ilya
 
             void write(const Color& color);
 
+            /// Write a whole framebuffer of `width*height` colors,
+            /// stored row by row from the top of the image.
+            void write(const std::vector<Color>& framebuffer);
+
         public:
 
             uint32_t width, height;
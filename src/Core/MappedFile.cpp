@@ -0,0 +1,99 @@
+
+#include "MappedFile.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Ilya
+{
+#ifdef _WIN32
+    MappedFile::MappedFile(const fs::path& path)
+    {
+        file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                           OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if(file == INVALID_HANDLE_VALUE)
+        {
+            file = nullptr;
+            error("ERROR: could not open file at path {}\n", path.string());
+            return;
+        }
+
+        LARGE_INTEGER file_size;
+        if(!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+        {
+            error("ERROR: could not map empty file at path {}\n", path.string());
+            return;
+        }
+
+        mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if(mapping)
+            data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+
+        if(!data)
+        {
+            error("ERROR: could not map file at path {}\n", path.string());
+            return;
+        }
+
+        size = static_cast<size_t>(file_size.QuadPart);
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if(data)
+            UnmapViewOfFile(data);
+        if(mapping)
+            CloseHandle(mapping);
+        if(file)
+            CloseHandle(file);
+    }
+#else
+    MappedFile::MappedFile(const fs::path& path)
+    {
+        auto fd = open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+        {
+            error("ERROR: could not open file at path {}\n", path.string());
+            return;
+        }
+
+        struct stat st {};
+        if(fstat(fd, &st) < 0 || st.st_size == 0)
+        {
+            error("ERROR: could not map empty file at path {}\n", path.string());
+            close(fd);
+            return;
+        }
+
+        // The mapping keeps the file alive, so the descriptor can be
+        // closed right away. The file is read from start to end (if
+        // by several threads), which the OS can use to read ahead.
+        auto addr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+
+        if(addr == MAP_FAILED)
+        {
+            error("ERROR: could not map file at path {}\n", path.string());
+            return;
+        }
+
+        madvise(addr, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+        data = static_cast<const char*>(addr);
+        size = static_cast<size_t>(st.st_size);
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if(data)
+            munmap(const_cast<char*>(data), size);
+    }
+#endif
+}
\ No newline at end of file
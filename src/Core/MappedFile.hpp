@@ -0,0 +1,45 @@
+
+#pragma once
+
+#include "Core.hpp"
+
+namespace Ilya
+{
+    /// @brief Read-only file mapped in memory
+    ///
+    /// The whole file is mapped at once and paged in by the OS as it
+    /// is read, without being copied in a buffer first: large files
+    /// can then be parsed by several threads at the same time, each
+    /// one reading its own part of the file directly. The mapping is
+    /// released with the object.
+    class MappedFile
+    {
+        public:
+
+            /// Map the file at `path`; on failure, print an error and
+            /// leave the mapping empty.
+            explicit MappedFile(const fs::path& path);
+            ~MappedFile();
+
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+
+            /// Is the file mapped ?
+            explicit operator bool() const { return data != nullptr; }
+
+            /// Contents of the file.
+            std::string_view view() const { return {data, size}; }
+
+        public:
+
+            const char* data = nullptr;
+            size_t size = 0;
+
+        private:
+
+#ifdef _WIN32
+            void* file = nullptr;
+            void* mapping = nullptr;
+#endif
+    };
+}
\ No newline at end of file
@@ -0,0 +1,106 @@
+
+#include "Parallel.hpp"
+
+#include <mutex>
+#include <thread>
+
+namespace Ilya
+{
+    /// Range of task indices owned by a worker, [begin, end[.
+    struct WorkRange
+    {
+        std::mutex mutex;
+        uint32_t begin, end;
+    };
+
+    uint32_t hardware_threads()
+    {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    static bool pop(WorkRange& range, uint32_t& idx)
+    {
+        std::scoped_lock lock {range.mutex};
+        if(range.begin >= range.end)
+            return false;
+
+        idx = range.begin++;
+        return true;
+    }
+
+    static bool steal(std::vector<WorkRange>& ranges, uint32_t thief)
+    {
+        // Go through the other workers in order, starting from the one
+        // after the thief and wrapping around, and rob the first one
+        // that still has a task left of the upper half of its range
+        // (rounded up, so a last task is taken too): the victim keeps
+        // working from the front of its range, so both threads stay on
+        // contiguous (and thus coherent, for tiles) blocks of work.
+        for (uint32_t k = 1; k < ranges.size(); ++k)
+        {
+            auto& victim = ranges[(thief + k) % ranges.size()];
+            uint32_t begin, end;
+            {
+                std::scoped_lock lock {victim.mutex};
+                auto left = victim.end - std::min(victim.begin, victim.end);
+                if(left == 0)
+                    continue;
+
+                end = victim.end;
+                begin = victim.end - (left + 1)/2;
+                victim.end = begin;
+            }
+
+            std::scoped_lock lock {ranges[thief].mutex};
+            ranges[thief].begin = begin;
+            ranges[thief].end = end;
+
+            return true;
+        }
+
+        return false;
+    }
+
+    void parallel_for(uint32_t count, const std::function<void(uint32_t)>& func,
+                      uint32_t threads)
+    {
+        if(threads == 0)
+            threads = hardware_threads();
+        threads = std::max(1u, std::min(threads, count));
+
+        if(threads == 1)
+        {
+            for (uint32_t i = 0; i < count; ++i)
+                func(i);
+
+            return;
+        }
+
+        // Split the index space evenly between the workers to begin
+        // with; the stealing takes care of the imbalance afterwards.
+        std::vector<WorkRange> ranges(threads);
+        for (uint32_t t = 0; t < threads; ++t)
+        {
+            ranges[t].begin = static_cast<uint32_t>(uint64_t(count) * t / threads);
+            ranges[t].end = static_cast<uint32_t>(uint64_t(count) * (t + 1) / threads);
+        }
+
+        auto worker = [&](uint32_t t)
+        {
+            uint32_t idx;
+            do
+            {
+                while(pop(ranges[t], idx))
+                    func(idx);
+            }
+            while(steal(ranges, t));
+        };
+
+        std::vector<std::jthread> workers;
+        for (uint32_t t = 1; t < threads; ++t)
+            workers.emplace_back(worker, t);
+
+        // The calling thread works as well instead of just waiting.
+        worker(0);
+    }
+}
@@ -0,0 +1,21 @@
+
+#pragma once
+
+#include "Core.hpp"
+
+#include <functional>
+
+namespace Ilya
+{
+    /// Number of hardware threads available, never less than 1.
+    uint32_t hardware_threads();
+
+    /// Calls `func(i)` for every index `i` in [0, count[ on `threads`
+    /// worker threads (0 picks the hardware concurrency), and returns
+    /// once all of them are done. Each worker starts with a contiguous
+    /// range of indices and, once it runs out of work, steals half of
+    /// the remaining range of another worker, so that uneven task
+    /// costs still keep every thread busy until the end.
+    void parallel_for(uint32_t count, const std::function<void(uint32_t)>& func,
+                      uint32_t threads = 0);
+}
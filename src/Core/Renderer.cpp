@@ -2,6 +2,11 @@
 #include "Renderer.hpp"
 #include "Utils/PDF.hpp"
 #include "Objects/Instances.hpp"
+#include "Parallel.hpp"
+#include "Allocations.hpp"
+
+#include <mutex>
+#include <span>
 
 namespace Ilya
 {
@@ -10,81 +15,296 @@ namespace Ilya
                         samples_per_pixel(samples), depth(depth)
     {}
 
-    Color Renderer::ray_color(const Ray& r, const Ref <Hittable>& light,
+    Color Renderer::ray_color(const Ray& r, const LightSampler& lights,
                               const Color& background, int depth)
     {
-        HitRecord rec {};
+        // The color of a pixel is the light carried along the path of
+        // the ray, which is the sum of the light emitted at each of the
+        // path vertices, attenuated by all the surfaces hit before it.
+        // Rather than recursing on each bounce, we follow the path
+        // forward and keep track of that attenuation (the path
+        // "throughput"): the light emitted at a vertex is added to the
+        // final color multiplied by the throughput so far, and the
+        // throughput is multiplied at each bounce by the attenuation
+        // of the surface.
+        Color radiance {};
+        Color throughput {1.f};
+        Ray ray = r;
+        PathVertex prev {};
 
-        if(depth <= 0)
-            return {};
+        for (int bounce = 0; bounce < depth; ++bounce)
+        {
+            HitRecord rec {};
+            Random::bounce(bounce);
+
+            // Check if the ray hits the 'world' hittable, and bounce
+            // off the surface with some Color attenuation (to
+            // approximate the fact that part of the rays are being
+            // absorbed by the material). The time at which rays are
+            // cast is not set exactly at 0: if we did so, because of
+            // floating point rounding errors, a bunch of the rays that
+            // were supposed to scatter off the surface actually would
+            // start a little under the surface, intersect with it and
+            // never get out. This would produce an image riddled with
+            // random black pixels, an outcome known as "shadow acne";
+            // setting the cast time at which the ray detection starts
+            // just a bit after 0 gets rid of most of it spectacularly
+            // well.
+            if(!world.hit(ray, 0.001f, infinity, rec))
+            {
+                radiance += throughput * background;
+                break;
+            }
+
+            ScatterRecord scatter {};
+            if(!shade(ray, rec, prev, lights, throughput, radiance, scatter))
+                break;
+
+            if(!scatter.is_specular)
+                radiance += throughput * direct_light(ray, rec, scatter, lights);
+
+            if(!next_ray(ray, rec, scatter, bounce, throughput, prev))
+                break;
+        }
+
+        return radiance;
+    }
+
+    Color Renderer::emitted(const HitRecord& rec) const
+    {
+        if(materials)
+            return materials->emitted(rec);
+
+        return MaterialTable::get(rec.material).emitted(rec.u, rec.v, rec.p, rec);
+    }
+
+    bool Renderer::shade(const Ray& r, const HitRecord& rec, const PathVertex& prev,
+                         const LightSampler& lights, const Color& throughput,
+                         Color& radiance, ScatterRecord& scatter) const
+    {
+        // A light that the path finds by bouncing off a surface could
+        // also have been sampled from that surface (see
+        // `direct_light()`): both estimates then count the same light,
+        // and each of them is weighted by how likely its own strategy
+        // was to find it compared to the other one (multiple importance
+        // sampling). This way, each light is mostly counted by the
+        // strategy that is best at finding it: sampling for the small
+        // or distant lights, which bounces rarely find, and bouncing
+        // for the lights that fill a large part of the sky of the
+        // surface, where the material aims better than the sampling
+        // of their whole surface does.
+        auto light = emitted(rec);
+
+        uint32_t index;
+        if(prev.pdf > 0.f && (light.r > 0.f || light.g > 0.f || light.b > 0.f)
+           && lights.find(r, rec.t, index))
+        {
+            auto light_pdf = lights.pmf(prev.p, prev.n, index) * lights[index].pdf_value(r);
+            light *= power_heuristic(prev.pdf, light_pdf);
+        }
+
+        radiance += throughput * light;
 
-        // Check if the ray hits the 'world' hittable, and bounce off
-        // the surface with some Color attenuation (to approximate the
-        // fact that part of the rays are being absorbed by the
-        // material). The time at which rays are cast is not set exactly
-        // at 0: if we did so, because of floating point rounding
-        // errors, a bunch of the rays that were supposed to scatter off
-        // the surface actually would start a little under the surface,
-        // intersect with it and never get out. This would produce an
-        // image riddled with random black pixels, an outcome known as
-        // "shadow acne"; setting the cast time at which the ray
-        // detection starts just a bit after 0 gets rid of most of it
-        // spectacularly well.
-        if(!world.hit(r, 0.001f, infinity, rec))
-            return background;
-
-        ScatterRecord scatter {};
-        Color emitted = rec.material->emitted(rec.u, rec.v, rec.p, rec);
         // If the ray doesn't scatter from the material, it means that
-        // it is emissive (it produces light); then the color we want to
-        // output is the color of the emitted light.
-        if(!rec.material->scatter(r, scatter, rec))
-            return emitted;
-
-        // If the ray reflection is specular, we don't need to play with
-        // PDFs like we do later, because each incoming ray scatters in
-        // a specific, calculable direction. The color change of the ray
-        // is then reduced to the material's albedo factor.
+        // it is emissive (it produces light), and the path ends there.
+        if(materials)
+            return materials->scatter(r, scatter, rec);
+
+        return MaterialTable::get(rec.material).scatter(r, scatter, rec);
+    }
+
+    Color Renderer::direct_light(const Ray& r, const HitRecord& rec, const ScatterRecord& scatter,
+                                 const LightSampler& lights) const
+    {
+        // Rather than waiting for the path to find a light by chance,
+        // pick one of the lights and a point on it, and connect the
+        // hit to that point with a shadow ray ("next event
+        // estimation"). In a medium, light comes from every direction,
+        // which the light sampler is told by a zero normal.
+        auto normal = scatter.pdf.surface() ? rec.normal : Vec3{0.f};
+        uint32_t index;
+        float pmf;
+        LightSample sample {};
+
+        if(!lights.sample(rec.p, normal, Random::rfloat(), index, pmf) ||
+           !lights[index].sample_light(rec.p, r.cast_time, sample))
+            return {};
+
+        Ray shadow {rec.p, sample.dir, r.cast_time};
+        auto scattering_pdf = materials ? materials->scattering_pdf(r, shadow, rec)
+                                        : MaterialTable::get(rec.material).scattering_pdf(r, shadow, rec);
+        if(scattering_pdf <= 0.f)
+            return {};
+
+        // The light sent towards the hit is found by intersecting the
+        // light alone, which tells which side of it faces the hit and
+        // where it is on its surface; it only gets there if nothing
+        // else in the scene is in the way, which the shadow ray checks
+        // up to just before the light.
+        HitRecord light_rec {};
+        if(!lights[index].hit(shadow, 0.001f, infinity, light_rec))
+            return {};
+
+        auto light = emitted(light_rec);
+        if(!(light.r > 0.f || light.g > 0.f || light.b > 0.f))
+            return {};
+
+        if(world.occluded(shadow, 0.001f, light_rec.t*(1.f - 1e-3f)))
+            return {};
+
+        // The same estimate as for a scattered ray (see `next_ray()`),
+        // with the density of the light sample, and weighted against
+        // the chance that the material would have scattered the ray
+        // there (see `shade()`).
+        auto light_pdf = pmf * sample.pdf;
+        auto weight = power_heuristic(light_pdf, scatter.pdf.val(sample.dir));
+
+        return scatter.albedo * light * (scattering_pdf * weight / light_pdf);
+    }
+
+    bool Renderer::next_ray(Ray& r, const HitRecord& rec, const ScatterRecord& scatter,
+                            uint32_t bounce, Color& throughput, PathVertex& vertex) const
+    {
         if(scatter.is_specular)
-            return scatter.albedo * ray_color(scatter.ray, light, background, depth - 1);
-
-        // If it is a regular material, create a mixture PDF from the
-        // light-directed PDF and the material PDF (contained in the
-        // ray scatter record).
-        auto light_pdf = std::make_shared<HittablePDF>(light, rec.p);
-        MixturePDF pdf {scatter.pdf, light_pdf};
-
-        Ray scattered = {rec.p, pdf.random_vector(), r.cast_time};
-        auto pdf_val = pdf.val(scattered.dir);
-
-        // In the other cases, we want the colors from both the emitted
-        // light and the ray itself. The ray color is multiplied by two
-        // factors: the albedo, which is the material's reflection
-        // color, and the scattering PDF, which represents the
-        // scattering distribution of the material (that is, which
-        // directions are privileged for the rays when scattering off
-        // the surface of this material). Now, the final color will the
-        // integration of this quantity over all directions. However,
-        // because of how we render our image -- sending rays in random
-        // directions --, actually integrating is neither simple nor
-        // useful. What we do instead is a statistical average of the
-        // color function, dividing by the value of the PDF for the
-        // scattered ray.
-        return emitted + scatter.albedo * rec.material->scattering_pdf(r, scattered, rec)
-                         * ray_color(scattered, light, background, depth - 1) / pdf_val;
+        {
+            // If the ray reflection is specular, we don't need to play
+            // with PDFs like we do later, because each incoming ray
+            // scatters in a specific, calculable direction. The color
+            // change of the ray is then reduced to the material's
+            // albedo factor. No light can be sampled in that direction,
+            // so a light found there is not weighted (see `shade()`).
+            throughput *= scatter.albedo;
+            r = scatter.ray;
+            vertex = {};
+        }
+        else
+        {
+            // If it is a regular material, the next direction follows
+            // the material PDF (contained in the ray scatter record)
+            // alone: the lights have already been sampled on their own
+            // (see `direct_light()`), and the light found in this
+            // direction, if any, is weighted against that sampling with
+            // the density kept in `vertex`.
+            auto dir = scatter.pdf.random_vector();
+            auto pdf_val = scatter.pdf.val(dir);
+            if(pdf_val <= 0.f)
+                return false;
+
+            Ray scattered {rec.p, dir, r.cast_time};
+
+            // The ray color is multiplied by two factors: the albedo,
+            // which is the material's reflection color, and the
+            // scattering PDF, which represents the scattering
+            // distribution of the material (that is, which directions
+            // are privileged for the rays when scattering off the
+            // surface of this material). Now, the final color will the
+            // integration of this quantity over all directions.
+            // However, because of how we render our image -- sending
+            // rays in random directions --, actually integrating is
+            // neither simple nor useful. What we do instead is a
+            // statistical average of the color function, dividing by
+            // the value of the PDF for the scattered ray.
+            auto scattering_pdf = materials ? materials->scattering_pdf(r, scattered, rec)
+                                            : MaterialTable::get(rec.material).scattering_pdf(r, scattered, rec);
+
+            throughput *= scatter.albedo * scattering_pdf / pdf_val;
+            r = scattered;
+            vertex = {rec.p, scatter.pdf.surface() ? rec.normal : Vec3{0.f}, pdf_val};
+        }
+
+        // Paths that have lost most of their energy still cost as much
+        // to trace as the others, for almost no contribution to the
+        // image. After a few bounces, we play "russian roulette" with
+        // them: the path is terminated with a probability q that grows
+        // as its throughput decreases, and if it survives, its
+        // throughput is divided by the survival probability 1 - q. On
+        // average, the path then carries the same amount of light as
+        // if it had never been terminated, so the image stays
+        // unbiased; only the variance increases a little.
+        if(bounce + 1 >= roulette_depth)
+        {
+            auto max = std::max({throughput.r, throughput.g, throughput.b});
+            auto q = std::max(0.05f, 1.f - max);
+            if(Random::rfloat() < q)
+                return false;
+
+            throughput *= 1.f/(1.f - q);
+        }
+
+        return true;
     }
 
-    void Renderer::render(const Camera& cam, const Ref<Hittable>& light)
+    void Renderer::render(const Camera& cam, const HittableList& lights)
     {
-        // We render the image from top to bottom, because the image is
-        // stored in memory from bottom to top. This is because the
-        // image is stored in a 1D array, and the first pixel is the
-        // bottom-left one.
-        for (int j = img.height - 1; j >= 0; --j)
+        // Split the image in square tiles, the last row and column of
+        // tiles being cut short if the image size is not a multiple of
+        // the tile size. Tiles are small enough that there are many
+        // more of them than threads, so that the work can be balanced
+        // between threads, and big enough that a thread works for a
+        // while on neighbouring pixels, whose rays tend to follow the
+        // same paths in the scene (and so touch the same memory).
+        std::vector<Tile> tiles;
+        for (uint32_t y = 0; y < img.height; y += tile_size)
+        {
+            for (uint32_t x = 0; x < img.width; x += tile_size)
+            {
+                tiles.push_back({x, y, std::min(x + tile_size, img.width),
+                                 std::min(y + tile_size, img.height)});
+            }
+        }
+
+        // Tiles are rendered into a framebuffer in memory, which is
+        // written to the image file in one go at the end: the file
+        // expects pixels in order, and threads finish their tiles in
+        // any order.
+        std::vector<Color> framebuffer(img.width * img.height);
+
+        if(compiled)
+            materials = std::make_unique<CompiledMaterials>();
+
+        LightSampler light_sampler {lights.objects, light_tree};
+
+        std::mutex progress_mutex;
+        auto tiles_left = tiles.size();
+
+        // Heap allocations made while rendering the tiles (only counted
+        // when building with `ILYA_COUNT_ALLOCATIONS`): tracing paths
+        // doesn't allocate anything, so this should stay at 0, except
+        // for the queues of the wavefront mode, allocated once per
+        // tile.
+        uint64_t allocations = 0;
+
+        parallel_for(tiles.size(), [&](uint32_t t)
         {
-            print("Scanlines remaining: {}\n", j);
+            auto start = allocation_count();
+
+            if(wavefront)
+                render_tile_wavefront(cam, light_sampler, tiles[t], framebuffer);
+            else
+                render_tile(cam, light_sampler, tiles[t], framebuffer);
+
+            Random::sample(nullptr);
+            auto tile_allocations = allocation_count() - start;
+
+            std::scoped_lock lock {progress_mutex};
+            allocations += tile_allocations;
+            print("Tiles remaining: {}\n", --tiles_left);
+        }, threads);
 
-            for (int i = 0; i < img.width; ++i)
+#ifdef ILYA_COUNT_ALLOCATIONS
+        print("Heap allocations while rendering: {}\n", allocations);
+#endif
+
+        materials.reset();
+        img.write(framebuffer);
+    }
+
+    void Renderer::render_tile(const Camera& cam, const LightSampler& lights,
+                               const Tile& tile, std::vector<Color>& framebuffer)
+    {
+        for (auto j = tile.y0; j < tile.y1; ++j)
+        {
+            for (auto i = tile.x0; i < tile.x1; ++i)
             {
                 Color pixel_Color {};
 
@@ -96,12 +316,25 @@ namespace Ilya
                 // is called "antialiasing" ("aliasing" being the name
                 // to the staircase look of pixels before
                 // postprocessing).
-                for (int s = 0; s < samples_per_pixel; ++s)
+                for (uint32_t s = 0; s < samples_per_pixel; ++s)
                 {
+                    // Each pixel draws from its own random stream, and
+                    // each sample from its own offset in that stream,
+                    // derived from the render seed: the random numbers
+                    // of a sample then only depend on which sample it
+                    // is, and not on the thread rendering it or the
+                    // order in which tiles are picked, so that the
+                    // result is the same whatever the number of threads.
+                    // With a sampler, the numbers are the dimensions of
+                    // the sample instead, which depend on the same
+                    // things.
+                    Random::seed(j * img.width + i, (uint64_t(seed) << 32u) | s);
+                    Random::sample(sampler.get(), i, j, s);
+
                     auto u = (i + Random::rfloat()) / (img.width - 1);
                     auto v = (j + Random::rfloat()) / (img.height - 1);
 
-                    pixel_Color += ray_color(cam.ray(u, v), light, {}, depth);
+                    pixel_Color += ray_color(cam.ray(u, v), lights, {}, depth);
                 }
 
                 // Because we have added as many colors together as
@@ -119,9 +352,230 @@ namespace Ilya
                 // colors to the power of 1/2.
                 pixel_Color = sqrt(pixel_Color/samples_per_pixel);
 
-                img.write(pixel_Color);
+                // The image is written from top to bottom, while j goes
+                // upwards, so rows are stored in reverse order.
+                framebuffer[(img.height - 1 - j) * img.width + i] = pixel_Color;
             }
+        }
+    }
+
+    /// Paths of a wavefront, stored field by field: each stage of
+    /// `Renderer::render_tile_wavefront()` only goes through the arrays
+    /// it needs, one path after the other. Slots [0, size[ hold the
+    /// paths still in flight, and `id` tells which sample each of them
+    /// belongs to.
+    struct PathQueue
+    {
+        explicit PathQueue(uint32_t capacity):
+            id(capacity), ray(capacity), throughput(capacity), prev(capacity),
+            rng(capacity), rec(capacity), hit(capacity), scatter(capacity),
+            alive(capacity), order(capacity)
+        {}
+
+        /// Move the paths that are still alive to the front of the
+        /// queue, keeping them in order.
+        void compact()
+        {
+            uint32_t n = 0;
+            for (uint32_t k = 0; k < size; ++k)
+            {
+                if(!alive[k])
+                    continue;
+
+                if(n != k)
+                {
+                    id[n] = id[k];
+                    ray[n] = ray[k];
+                    throughput[n] = throughput[k];
+                    prev[n] = prev[k];
+                    rng[n] = rng[k];
+                }
+
+                ++n;
+            }
+
+            size = n;
+        }
+
+        uint32_t size = 0;
+
+        std::vector<uint32_t> id;
+        std::vector<Ray> ray;
+        std::vector<Color> throughput;
+        std::vector<PathVertex> prev;
+        std::vector<Random::State> rng;
+        std::vector<HitRecord> rec;
+        std::vector<uint8_t> hit;
+        std::vector<ScatterRecord> scatter;
+        std::vector<uint8_t> alive;
+        std::vector<uint32_t> order;
+    };
+
+    void Renderer::render_tile_wavefront(const Camera& cam, const LightSampler& lights,
+                                         const Tile& tile, std::vector<Color>& framebuffer)
+    {
+        // Instead of following each path from start to end before
+        // starting the next one like `render_tile()` does, all the
+        // paths of the tile are started together, and the whole
+        // wavefront advances one bounce at a time through separate
+        // stages: finding the hits of all the rays, then shading all
+        // the hits, then sampling the lights from all of them, then
+        // picking all the next rays. Each stage runs
+        // the same code on many paths in a row, which keeps that code
+        // and the data it touches (BVH nodes, materials, textures) in
+        // the caches, instead of going through all of it for every
+        // single path. Paths that end are removed from the wavefront
+        // between bounces, so that the stages only go through the
+        // paths still in flight.
+        auto width = tile.x1 - tile.x0;
+        auto pixels = width * (tile.y1 - tile.y0);
+
+        // The tile is rendered in passes of a few samples per pixel,
+        // so that the wavefront stays within `wavefront_size` paths
+        // (the upper bound of the clamp must not fall below the lower
+        // one, even without samples).
+        auto pass_samples = std::clamp(wavefront_size / pixels, 1u, std::max(1u, samples_per_pixel));
+
+        // Rays that escape the scene get the same (black) background
+        // as in `render_tile()`.
+        const Color background {};
+
+        PathQueue queue {pixels * pass_samples};
+        std::vector<Color> radiance(pixels * pass_samples);
+        std::vector<Color> pixel_Color(pixels);
+
+        for (uint32_t s0 = 0; s0 < samples_per_pixel; s0 += pass_samples)
+        {
+            auto samples = std::min(pass_samples, samples_per_pixel - s0);
+
+            // Start the path of every sample of the pass from the
+            // camera; each path carries its own random engine, seeded
+            // like in `render_tile()`, and every stage switches to it
+            // while working on the path, so that a path draws the same
+            // numbers as it would if it was traced on its own.
+            queue.size = pixels * samples;
+            for (uint32_t k = 0; k < queue.size; ++k)
+            {
+                auto i = tile.x0 + (k / samples) % width;
+                auto j = tile.y0 + (k / samples) / width;
+                auto s = s0 + k % samples;
+
+                Random::seed(j * img.width + i, (uint64_t(seed) << 32u) | s);
+                Random::sample(sampler.get(), i, j, s);
+
+                auto u = (i + Random::rfloat()) / (img.width - 1);
+                auto v = (j + Random::rfloat()) / (img.height - 1);
+
+                queue.id[k] = k;
+                queue.ray[k] = cam.ray(u, v);
+                queue.throughput[k] = Color{1.f};
+                queue.prev[k] = {};
+                queue.rng[k] = Random::save();
+                radiance[k] = {};
+            }
+
+            for (uint32_t bounce = 0; bounce < depth && queue.size > 0; ++bounce)
+            {
+                // Intersection stage.
+                for (uint32_t k = 0; k < queue.size; ++k)
+                {
+                    Random::restore(queue.rng[k]);
+                    Random::bounce(bounce);
+                    queue.rec[k] = {};
+                    queue.hit[k] = world.hit(queue.ray[k], 0.001f, infinity, queue.rec[k]);
+                    queue.rng[k] = Random::save();
+                }
+
+                // With compiled materials, the material and sampling
+                // stages go through the paths grouped by the type of
+                // material they hit (a counting sort on the type), so
+                // that each type of material is shaded for many paths
+                // in a row; paths that missed everything come first.
+                if(materials)
+                {
+                    uint32_t offsets[CompiledMaterials::kinds + 2] {};
+                    auto key = [&](uint32_t k)
+                    {
+                        return queue.hit[k] ? 1 + materials->kind(queue.rec[k].material) : 0u;
+                    };
+
+                    for (uint32_t k = 0; k < queue.size; ++k)
+                        ++offsets[key(k) + 1];
+                    for (uint32_t i = 1; i < CompiledMaterials::kinds + 2; ++i)
+                        offsets[i] += offsets[i - 1];
+                    for (uint32_t k = 0; k < queue.size; ++k)
+                        queue.order[offsets[key(k)]++] = k;
+                }
+                else
+                {
+                    for (uint32_t k = 0; k < queue.size; ++k)
+                        queue.order[k] = k;
+                }
+
+                // Material stage: emission of the surfaces hit, and
+                // scattering off them (see `ray_color()`).
+                for (auto k: std::span{queue.order.data(), queue.size})
+                {
+                    if(!queue.hit[k])
+                    {
+                        radiance[queue.id[k]] += queue.throughput[k] * background;
+                        queue.alive[k] = false;
+                        continue;
+                    }
+
+                    Random::restore(queue.rng[k]);
+                    queue.scatter[k] = {};
+                    queue.alive[k] = shade(queue.ray[k], queue.rec[k], queue.prev[k], lights,
+                                           queue.throughput[k], radiance[queue.id[k]],
+                                           queue.scatter[k]);
+                    queue.rng[k] = Random::save();
+                }
+
+                // Light stage: the lights sampled from the hits that
+                // scatter, each with its shadow ray.
+                for (auto k: std::span{queue.order.data(), queue.size})
+                {
+                    if(!queue.alive[k] || queue.scatter[k].is_specular)
+                        continue;
+
+                    Random::restore(queue.rng[k]);
+                    radiance[queue.id[k]] += queue.throughput[k] *
+                            direct_light(queue.ray[k], queue.rec[k], queue.scatter[k], lights);
+                    queue.rng[k] = Random::save();
+                }
+
+                // Sampling stage: direction of the next rays, and
+                // russian roulette.
+                for (auto k: std::span{queue.order.data(), queue.size})
+                {
+                    if(!queue.alive[k])
+                        continue;
+
+                    Random::restore(queue.rng[k]);
+                    queue.alive[k] = next_ray(queue.ray[k], queue.rec[k], queue.scatter[k],
+                                              bounce, queue.throughput[k], queue.prev[k]);
+                    queue.rng[k] = Random::save();
+                }
+
+                queue.compact();
+            }
+
+            // Accumulation stage: add up the samples of each pixel, in
+            // the same order as `render_tile()` does.
+            for (uint32_t p = 0; p < pixels; ++p)
+            {
+                for (uint32_t s = 0; s < samples; ++s)
+                    pixel_Color[p] += radiance[p * samples + s];
+            }
+        }
+
+        for (uint32_t p = 0; p < pixels; ++p)
+        {
+            auto i = tile.x0 + p % width;
+            auto j = tile.y0 + p / width;
 
+            // Same gamma correction as in `render_tile()`.
+            framebuffer[(img.height - 1 - j) * img.width + i] = sqrt(pixel_Color[p]/samples_per_pixel);
         }
     }
 }
\ No newline at end of file
@@ -4,35 +4,141 @@
 #include "Image.hpp"
 #include "Objects/Ray.hpp"
 #include "Objects/Hittable.hpp"
+#include "Objects/LightSampler.hpp"
 #include "Objects/Camera.hpp"
+#include "Objects/Material.hpp"
+#include "Objects/CompiledMaterials.hpp"
+#include "Utils/Sampler.hpp"
 
 namespace Ilya
 {
+    /// Where the ray of a path was scattered from: the point and
+    /// normal of the previous hit (the normal is zero in a medium),
+    /// and the density with which the material there picked the
+    /// direction of the ray, or 0 if the light that the ray finds
+    /// could not have been sampled explicitly from there (rays from
+    /// the camera, specular bounces).
+    struct PathVertex
+    {
+        Point3 p;
+        Vec3 n;
+        float pdf = 0.f;
+    };
+
     class Renderer
     {
         public:
 
             uint32_t samples_per_pixel, depth;
 
+            /// Number of threads used to render (0 uses every hardware
+            /// thread), side in pixels of the square tiles the image is
+            /// split into, and seed of the per-pixel random sequences.
+            uint32_t threads = 0, tile_size = 16, seed = 0;
+
+            /// Number of bounces after which paths start being randomly
+            /// terminated by russian roulette (see `next_ray()`).
+            uint32_t roulette_depth = 3;
+
+            /// Trace paths in wavefronts rather than one at a time (see
+            /// `render_tile_wavefront()`), with at most `wavefront_size`
+            /// paths in flight per thread. Both modes give the same
+            /// image.
+            bool wavefront = false;
+            uint32_t wavefront_size = 1 << 14;
+
+            /// Render with a compiled copy of the scene materials (see
+            /// `CompiledMaterials`) rather than calling them virtually.
+            /// Both give the same image.
+            bool compiled = false;
+
+            /// Pick the light sampled at each bounce with the light BVH
+            /// (see `LightSampler`), which favours the lights that are
+            /// bright, close and turned towards the point, rather than
+            /// with the power of the lights alone.
+            bool light_tree = true;
+
+            /// Where the random numbers of the samples come from (see
+            /// `Sampler`); without a sampler, they are drawn from the
+            /// independent random engine of `Random`.
+            Ref<Sampler> sampler;
+
             Renderer(const Image& img, const HittableList& world, uint32_t samples, uint32_t depth);
 
             /// Render the image producing a number of rays per pixel from
             /// the camera in a random direction and calling `ray_color()`
-            /// to get the pixel color.
-            void render(const Camera& cam, const Ref<Hittable>& light);
+            /// to get the pixel color. The image is split in tiles that
+            /// are rendered in parallel into a framebuffer, which is
+            /// written to the image file once every tile is done.
+            ///
+            /// The objects of `lights` are the ones that are sampled
+            /// explicitly at each bounce (see `direct_light()`), apart
+            /// from the scene geometry; they must also be part of the
+            /// world, where the paths that hit them by bouncing find
+            /// their light. Emissive objects that are not in `lights`
+            /// are only found by bouncing.
+            void render(const Camera& cam, const HittableList& lights);
 
             uint32_t getWidth() const { return img.width; }
             uint32_t getHeight() const { return img.height; }
 
         private:
 
-            /// Take a ray `r` and recursively hit while it is not absorbed
-            /// with depth `depth`. If it doesn't hit anything, return
-            /// `background`; else, the ray color and emission light.
-            Color ray_color(const Ray& r, const Ref<Hittable>& light,
+            /// Rectangle of pixels [x0, x1[ x [y0, y1[ of the image,
+            /// with y going upwards.
+            struct Tile
+            {
+                uint32_t x0, y0, x1, y1;
+            };
+
+            /// Render every pixel of `tile` into `framebuffer`.
+            void render_tile(const Camera& cam, const LightSampler& lights,
+                             const Tile& tile, std::vector<Color>& framebuffer);
+
+            /// Render every pixel of `tile` into `framebuffer`, tracing
+            /// all the paths of the tile together one bounce at a time.
+            void render_tile_wavefront(const Camera& cam, const LightSampler& lights,
+                                       const Tile& tile, std::vector<Color>& framebuffer);
+
+            /// Follow the path of the ray `r` as it bounces in the scene,
+            /// for at most `depth` bounces, and return the light it
+            /// carries back: the light of the lights sampled at each
+            /// bounce, the emission of the surfaces it hits, and
+            /// `background` if it escapes the scene.
+            Color ray_color(const Ray& r, const LightSampler& lights,
                             const Color& background, int depth);
 
+            /// Light emitted by the surface at the hit `rec`.
+            Color emitted(const HitRecord& rec) const;
+
+            /// Add the light emitted at the hit `rec` of the ray `r`
+            /// to `radiance`, weighted by the path `throughput` and by
+            /// its MIS weight against the sampling of the `lights` from
+            /// `prev`, and scatter the ray off the material into
+            /// `scatter`. Returns false if the ray is absorbed and the
+            /// path ends there.
+            bool shade(const Ray& r, const HitRecord& rec, const PathVertex& prev,
+                       const LightSampler& lights, const Color& throughput,
+                       Color& radiance, ScatterRecord& scatter) const;
+
+            /// Light that reaches the hit `rec` of the ray `r` from one
+            /// of the `lights`, sampled explicitly and traced with a
+            /// shadow ray, and scattered along the ray by the material
+            /// (see `scatter`), with its MIS weight against the
+            /// scattering of the material.
+            Color direct_light(const Ray& r, const HitRecord& rec, const ScatterRecord& scatter,
+                               const LightSampler& lights) const;
+
+            /// Pick the direction of the next ray `r` of the path after
+            /// `scatter`, update the path `throughput` accordingly, and
+            /// keep in `vertex` where it was picked from. Returns false
+            /// if the path ends there, or is terminated by russian
+            /// roulette after this `bounce`.
+            bool next_ray(Ray& r, const HitRecord& rec, const ScatterRecord& scatter,
+                          uint32_t bounce, Color& throughput, PathVertex& vertex) const;
+
             Image img;
             HittableList world;
+            std::unique_ptr<CompiledMaterials> materials;
     };
 }
\ No newline at end of file
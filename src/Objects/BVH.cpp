@@ -0,0 +1,405 @@
+
+#include "BVH.hpp"
+
+#include <bit>
+#include <thread>
+
+namespace Ilya
+{
+    void build_ranges(std::vector<LinearBVHnode>& tree, std::vector<BVHprimitive>& prims,
+                      size_t start, size_t end, uint32_t threads,
+                      uint32_t max_leaf, uint32_t width, uint32_t depth)
+    {
+        auto count = end - start;
+        auto s = BVHnode::split(prims, start, end, threads, depth, max_leaf, width);
+
+        auto idx = tree.size();
+        tree.push_back({});
+
+        // The slab test of the boxes rounds its distances, and could
+        // miss a ray going exactly through a vertex at the corner of a
+        // box, even though the primitives themselves would be hit (a
+        // triangle intersection is watertight, see `TriangleMesh`):
+        // the boxes are slightly enlarged so that they err on the side
+        // of being hit. As for `Rectangle`, a box cannot have zero
+        // width either, which the relative margin alone would leave to
+        // flat primitives lying in a plane through the origin.
+        tree[idx].box = s.box;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            auto pad = std::max(1e-6f*(std::abs(s.box.min[axis]) + std::abs(s.box.max[axis])), 0.0001f);
+            tree[idx].box.min[axis] -= pad;
+            tree[idx].box.max[axis] += pad;
+        }
+
+        // `split()` leaves at most `max_leaf` primitives in a leaf.
+        if(s.leaf)
+        {
+            tree[idx].first = static_cast<uint32_t>(start);
+            tree[idx].count = static_cast<uint16_t>(count);
+            return;
+        }
+
+        tree[idx].count = 0;
+        tree[idx].axis = static_cast<uint8_t>(s.axis);
+
+        // The nodes are laid out in depth-first order, as for
+        // `LinearBVH`: the first child comes right after its parent.
+        if(threads == 1 || count < BVHnode::parallel_build_size)
+        {
+            build_ranges(tree, prims, start, s.mid, 1, max_leaf, width, depth + 1);
+            tree[idx].second_child = static_cast<uint32_t>(tree.size());
+            build_ranges(tree, prims, s.mid, end, 1, max_leaf, width, depth + 1);
+            return;
+        }
+
+        // As in `BVHnode::build()`, large children are built at the
+        // same time; the second one goes to a separate array, which
+        // is appended after the first one with its child indices
+        // shifted accordingly (leaves index the primitives, which
+        // don't move).
+        auto left_threads = static_cast<uint32_t>(std::lround(float(threads)*(s.mid - start)/count));
+        left_threads = std::clamp(left_threads, 1u, threads - 1);
+
+        std::vector<LinearBVHnode> right;
+        {
+            std::jthread worker {[&]
+            {
+                build_ranges(right, prims, s.mid, end, threads - left_threads, max_leaf, width, depth + 1);
+            }};
+
+            build_ranges(tree, prims, start, s.mid, left_threads, max_leaf, width, depth + 1);
+        }
+
+        auto offset = static_cast<uint32_t>(tree.size());
+        tree[idx].second_child = offset;
+
+        for (auto node: right)
+        {
+            if(node.count == 0)
+                node.second_child += offset;
+            tree.push_back(node);
+        }
+    }
+
+    LinearBVH::LinearBVH(const BVHnode& root)
+    {
+        auto stats = root.stats();
+        nodes.reserve(stats.nodes);
+        prims.reserve(stats.primitives);
+        objects.reserve(stats.primitives);
+
+        if(stats.primitives > 0)
+            flatten(root);
+    }
+
+    uint32_t LinearBVH::flatten(const BVHnode& node)
+    {
+        auto idx = static_cast<uint32_t>(nodes.size());
+        nodes.push_back({});
+        nodes[idx].box = node.box;
+
+        if(!node.left)
+        {
+            // Leaves point to a range of the primitive array, in which
+            // their objects are copied in order (there are at most
+            // `BVHnode::max_leaf_size` of them, see `BVHnode::split()`).
+            nodes[idx].first = static_cast<uint32_t>(prims.size());
+            nodes[idx].count = static_cast<uint16_t>(node.leaf.size());
+
+            for (const auto& obj: node.leaf)
+            {
+                prims.push_back(obj.get());
+                objects.push_back(obj);
+            }
+
+            return idx;
+        }
+
+        // The first child is flattened right after its parent, so only
+        // the index of the second one is needed (note that `nodes` may
+        // be reallocated while flattening the children, so we can't
+        // keep a reference to the parent node around).
+        flatten(*node.left);
+        auto second = flatten(*node.right);
+
+        nodes[idx].second_child = second;
+        nodes[idx].count = 0;
+        nodes[idx].axis = static_cast<uint8_t>(node.axis);
+
+        return idx;
+    }
+
+    bool LinearBVH::hit(const Ray& r, float tmin, float tmax, HitRecord& rec) const
+    {
+        return traverse(nodes, r, tmin, tmax, [&](uint32_t first, uint32_t count, float& tmax)
+        {
+            // Test the ray against each object of the leaf, reducing
+            // the range each time one is hit (see `HittableList::hit()`).
+            bool hit = false;
+            for (uint32_t i = first; i < first + count; ++i)
+            {
+                if(prims[i]->hit(r, tmin, tmax, rec))
+                {
+                    hit = true;
+                    tmax = rec.t;
+                }
+            }
+
+            return hit;
+        });
+    }
+
+    bool LinearBVH::occluded(const Ray& r, float tmin, float tmax) const
+    {
+        return traverse<true>(nodes, r, tmin, tmax, [&](uint32_t first, uint32_t count, float&)
+        {
+            for (uint32_t i = first; i < first + count; ++i)
+            {
+                if(prims[i]->occluded(r, tmin, tmax))
+                    return true;
+            }
+
+            return false;
+        });
+    }
+
+    bool LinearBVH::bounds(Bounds& box, float t0, float t1) const
+    {
+        if(nodes.empty())
+            return false;
+
+        box = nodes[0].box;
+        return true;
+    }
+
+    template<int N>
+    WideBVH<N>::WideBVH(const BVHnode& root)
+    {
+        auto stats = root.stats();
+        nodes.reserve(stats.nodes/2 + 1);
+        prims.reserve(stats.primitives);
+        objects.reserve(stats.primitives);
+
+        box = root.box;
+        if(stats.primitives > 0)
+            collapse(root);
+    }
+
+    template<int N>
+    uint32_t WideBVH<N>::collapse(const BVHnode& node)
+    {
+        auto idx = static_cast<uint32_t>(nodes.size());
+        nodes.push_back({});
+
+        // Gather the children of the node: starting from the two
+        // children of the binary node (or the node itself if it is
+        // a leaf), replace the inner node with the largest area by its
+        // own children until there are N of them, or only leaves are
+        // left. Opening the largest nodes first keeps the children
+        // about the same size, which is what the SAH would favor.
+        std::vector<const BVHnode*> children;
+        if(node.left)
+            children = {node.left.get(), node.right.get()};
+        else
+            children = {&node};
+
+        while(children.size() < N)
+        {
+            int largest = -1;
+            float largest_area = -1.f;
+            for (size_t i = 0; i < children.size(); ++i)
+            {
+                if(children[i]->left && children[i]->box.area() > largest_area)
+                {
+                    largest = i;
+                    largest_area = children[i]->box.area();
+                }
+            }
+
+            if(largest < 0)
+                break;
+
+            auto opened = children[largest];
+            children[largest] = opened->left.get();
+            children.push_back(opened->right.get());
+        }
+
+        // As in `LinearBVH::flatten()`, `nodes` may be reallocated by
+        // the recursive calls, so the node is always accessed through
+        // its index.
+        for (size_t i = 0; i < children.size(); ++i)
+        {
+            const auto& child = *children[i];
+            nodes[idx].boxes.set(i, child.box);
+
+            // Leaves hold at most `BVHnode::max_leaf_size` objects (see
+            // `BVHnode::split()`).
+            if(!child.left)
+            {
+                nodes[idx].child[i] = static_cast<uint32_t>(prims.size());
+                nodes[idx].count[i] = static_cast<uint16_t>(child.leaf.size());
+
+                for (const auto& obj: child.leaf)
+                {
+                    prims.push_back(obj.get());
+                    objects.push_back(obj);
+                }
+            }
+            else
+            {
+                auto child_idx = collapse(child);
+                nodes[idx].child[i] = child_idx;
+                nodes[idx].count[i] = 0;
+            }
+        }
+
+        for (int i = children.size(); i < N; ++i)
+        {
+            nodes[idx].child[i] = 0;
+            nodes[idx].count[i] = 0;
+        }
+
+        return idx;
+    }
+
+    template<int N>
+    template<bool any, typename F>
+    bool WideBVH<N>::walk(const Ray& r, float tmin, float tmax, F&& leaf) const
+    {
+        if(nodes.empty())
+            return false;
+
+        // Children left to visit, with the distance at which the ray
+        // enters their box: when a child is popped after a hit closer
+        // than that distance, it can be skipped without testing
+        // anything. Each level of the tree pushes at most N-1 entries
+        // on top of the ones of the levels above, and the collapsed
+        // tree is no deeper than the binary one (see
+        // `BVHnode::max_depth`).
+        struct Entry
+        {
+            uint32_t child;
+            uint16_t count;
+            float t;
+        };
+
+        Entry stack[BVHnode::max_depth*N];
+        uint32_t top = 0;
+        stack[top++] = {0, 0, tmin};
+        bool hit = false;
+
+        while(top > 0)
+        {
+            auto entry = stack[--top];
+            if(entry.t > tmax)
+                continue;
+
+            if(entry.count > 0)
+            {
+                if(leaf(entry.child, uint32_t(entry.count), tmax))
+                {
+                    if constexpr(any)
+                        return true;
+
+                    hit = true;
+                }
+
+                continue;
+            }
+
+            const auto& node = nodes[entry.child];
+            vfloat<N> tnear;
+            auto mask = node.boxes.hit(r, tmin, tmax, tnear);
+            if(!mask)
+                continue;
+
+            float t[N];
+            tnear.store(t);
+
+            // Any hit will do for occlusion tests, and the range never
+            // shrinks, so the children are pushed as they come.
+            if constexpr(any)
+            {
+                for (; mask; mask &= mask - 1)
+                {
+                    int i = std::countr_zero(mask);
+                    stack[top++] = {node.child[i], node.count[i], t[i]};
+                }
+
+                continue;
+            }
+
+            // Otherwise, sort the children that were hit from the
+            // farthest to the nearest, and push them in that order so
+            // that the nearest one is visited first. There are at most
+            // N of them, so an insertion sort is all we need.
+            Entry hits[N];
+            int count = 0;
+            for (; mask; mask &= mask - 1)
+            {
+                int i = std::countr_zero(mask);
+                Entry e {node.child[i], node.count[i], t[i]};
+
+                int j = count++;
+                for (; j > 0 && hits[j - 1].t < e.t; --j)
+                    hits[j] = hits[j - 1];
+                hits[j] = e;
+            }
+
+            for (int i = 0; i < count; ++i)
+                stack[top++] = hits[i];
+        }
+
+        return hit;
+    }
+
+    template<int N>
+    bool WideBVH<N>::hit(const Ray& r, float tmin, float tmax, HitRecord& rec) const
+    {
+        return walk(r, tmin, tmax, [&](uint32_t first, uint32_t count, float& tmax)
+        {
+            // Test the objects of the leaf, reducing the range each
+            // time one is hit (see `HittableList::hit()`).
+            bool hit = false;
+            for (uint32_t i = first; i < first + count; ++i)
+            {
+                if(prims[i]->hit(r, tmin, tmax, rec))
+                {
+                    hit = true;
+                    tmax = rec.t;
+                }
+            }
+
+            return hit;
+        });
+    }
+
+    template<int N>
+    bool WideBVH<N>::occluded(const Ray& r, float tmin, float tmax) const
+    {
+        return walk<true>(r, tmin, tmax, [&](uint32_t first, uint32_t count, float&)
+        {
+            for (uint32_t i = first; i < first + count; ++i)
+            {
+                if(prims[i]->occluded(r, tmin, tmax))
+                    return true;
+            }
+
+            return false;
+        });
+    }
+
+    template<int N>
+    bool WideBVH<N>::bounds(Bounds& box, float t0, float t1) const
+    {
+        if(nodes.empty())
+            return false;
+
+        box = this->box;
+        return true;
+    }
+
+    template class WideBVH<4>;
+    template class WideBVH<8>;
+}
\ No newline at end of file
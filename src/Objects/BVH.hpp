@@ -0,0 +1,206 @@
+
+#pragma once
+
+#include "Hittable.hpp"
+
+namespace Ilya
+{
+    /// Node of a `LinearBVH`. Nodes are stored in depth-first order,
+    /// so that the first child of an inner node is the node right
+    /// after it, and only the offset of the second child needs to be
+    /// stored; leaves store the range of their primitives instead.
+    /// Everything fits in 32 bytes, so that two nodes share a cache
+    /// line.
+    struct alignas(32) LinearBVHnode
+    {
+        Bounds box;
+
+        union
+        {
+            uint32_t first;         // leaves: index of the first primitive
+            uint32_t second_child;  // inner nodes: index of the second child
+        };
+
+        uint16_t count;  // number of primitives, 0 for inner nodes
+        uint8_t axis;    // split axis of inner nodes
+        uint8_t pad;
+    };
+
+    static_assert(sizeof(LinearBVHnode) == 32);
+
+    /// Walk the tree of `LinearBVHnode`s `nodes` with the ray `r`
+    /// between `tmin` and `tmax`, and call `leaf(first, count, tmax)`
+    /// on each leaf whose box is hit; `leaf` returns whether it hit one
+    /// of its primitives, in which case it has lowered `tmax` to that
+    /// hit. Returns whether anything was hit. With `any`, the walk
+    /// stops at the first leaf that hits something, which is all that
+    /// occlusion tests need (see `Hittable::occluded()`).
+    template<bool any = false, typename F>
+    bool traverse(const std::vector<LinearBVHnode>& nodes, const Ray& r,
+                  float tmin, float tmax, F&& leaf)
+    {
+        if(nodes.empty())
+            return false;
+
+        // When the ray goes towards the negative side of the split axis
+        // of a node, the second child (on the positive side) is the
+        // closest one: visiting the closest child first gives a hit
+        // sooner, which shortens the ray and allows to skip the boxes
+        // of the other child that lie behind that hit.
+        const auto& dir_is_neg = r.dir_is_neg;
+
+        // Nodes left to visit, one at most for each level above the
+        // current node (see `BVHnode::max_depth`).
+        uint32_t stack[BVHnode::max_depth];
+        uint32_t top = 0;
+        uint32_t current = 0;
+        bool hit = false;
+
+        while(true)
+        {
+            const auto& node = nodes[current];
+
+            if(node.box.hit(r, tmin, tmax))
+            {
+                if(node.count > 0)
+                {
+                    if(leaf(node.first, uint32_t(node.count), tmax))
+                    {
+                        if constexpr(any)
+                            return true;
+
+                        hit = true;
+                    }
+
+                    if(top == 0)
+                        break;
+                    current = stack[--top];
+                }
+                else if(dir_is_neg[node.axis])
+                {
+                    stack[top++] = current + 1;
+                    current = node.second_child;
+                }
+                else
+                {
+                    stack[top++] = node.second_child;
+                    current = current + 1;
+                }
+            }
+            else
+            {
+                if(top == 0)
+                    break;
+                current = stack[--top];
+            }
+        }
+
+        return hit;
+    }
+
+    /// Append the node over the primitives [start, end[ of `prims` and
+    /// its subtree to `tree`, using up to `threads` threads. This is
+    /// the BVH that objects keep over their own primitives (see
+    /// `TriangleMesh`), walked with `traverse()`: the SAH splits are
+    /// those of `BVHnode`, `prims` is reordered in place, and leaves
+    /// are ranges of it, so that the object only has to store its
+    /// primitives in that order. `max_leaf` and `width` are passed
+    /// on to `BVHnode::split()`, as well as the `depth` of the node.
+    void build_ranges(std::vector<LinearBVHnode>& tree, std::vector<BVHprimitive>& prims,
+                      size_t start, size_t end, uint32_t threads,
+                      uint32_t max_leaf = BVHnode::max_leaf_size, uint32_t width = 1,
+                      uint32_t depth = 0);
+
+    /// BVH compiled into a contiguous array of compact nodes: rather
+    /// than following pointers from node to node and calling `hit()`
+    /// virtually on each of them like `BVHnode` does, traversal is a
+    /// loop over indices in the array with an explicit stack.
+    class LinearBVH: public Hittable
+    {
+        public:
+
+            /// Flatten the tree under `root`.
+            explicit LinearBVH(const BVHnode& root);
+
+            /// Build a `BVHnode` over the objects of `list` and flatten
+            /// it.
+            explicit LinearBVH(const HittableList& list, float t0 = 0.f, float t1 = 1.f):
+                LinearBVH(BVHnode{list, t0, t1}) {}
+
+            bool hit(const Ray& r, float tmin, float tmax, HitRecord& rec) const override;
+            bool occluded(const Ray& r, float tmin, float tmax) const override;
+            bool bounds(Bounds& box, float t0, float t1) const override;
+
+        private:
+
+            /// Append `node` and its subtree to the arrays, and return
+            /// its index.
+            uint32_t flatten(const BVHnode& node);
+
+            std::vector<LinearBVHnode> nodes;
+            std::vector<const Hittable*> prims;
+            std::vector<Ref<Hittable>> objects;
+    };
+
+    /// Node of a `WideBVH<N>`: the bounds of its (up to) N children,
+    /// stored side by side so that they are all tested at once, and
+    /// for each child either the index of its node (if `count` is 0)
+    /// or the range of its primitives (if it is a leaf). Unused slots
+    /// have an empty box that no ray hits.
+    template<int N>
+    struct WideBVHnode
+    {
+        BoundsPack<N> boxes;
+        uint32_t child[N];
+        uint16_t count[N];
+    };
+
+    /// @brief BVH with N children per node
+    ///
+    /// Built by collapsing a binary `BVHnode` tree: each node pulls in
+    /// the children and grandchildren of its binary counterpart, always
+    /// opening the largest inner node first, until it has N children.
+    /// The tree is then about log2(N) times shallower, and at each node
+    /// a single SIMD slab test (see `BoundsPack`) checks all of the
+    /// children against the ray, which are then visited from the
+    /// nearest to the farthest. N = 4 maps to SSE, N = 8 to AVX.
+    template<int N>
+    class WideBVH: public Hittable
+    {
+        public:
+
+            /// Collapse the tree under `root`.
+            explicit WideBVH(const BVHnode& root);
+
+            /// Build a `BVHnode` over the objects of `list` and
+            /// collapse it.
+            explicit WideBVH(const HittableList& list, float t0 = 0.f, float t1 = 1.f):
+                WideBVH(BVHnode{list, t0, t1}) {}
+
+            bool hit(const Ray& r, float tmin, float tmax, HitRecord& rec) const override;
+            bool occluded(const Ray& r, float tmin, float tmax) const override;
+            bool bounds(Bounds& box, float t0, float t1) const override;
+
+        private:
+
+            /// Append a node collapsing the subtree under `node`, and
+            /// return its index.
+            uint32_t collapse(const BVHnode& node);
+
+            /// Walk the tree with the ray `r` between `tmin` and `tmax`
+            /// and call `leaf(first, count, tmax)` on each leaf whose
+            /// box is hit, as `traverse()` does for the binary trees
+            /// (with the same meaning of `any`). Children are visited
+            /// nearest first, except for `any` walks.
+            template<bool any = false, typename F>
+            bool walk(const Ray& r, float tmin, float tmax, F&& leaf) const;
+
+            std::vector<WideBVHnode<N>> nodes;
+            std::vector<const Hittable*> prims;
+            std::vector<Ref<Hittable>> objects;
+            Bounds box;
+    };
+
+    using BVH4 = WideBVH<4>;
+    using BVH8 = WideBVH<8>;
+}
\ No newline at end of file
@@ -12,58 +12,91 @@ namespace Ilya
         // easier to calculate; if the ray doesn't hit the
         // bounding volume, it won't hit the object either, so
         // it can be discarded.
+        const auto& near = r.dir_is_neg;
         for (int i = 0; i < 3; ++i)
         {
             // To check if the ray hits the bounding volume, we
             // can use the slab method: first, calculate the
             // times t0 and t1 at which the ray hits the
-            // volume's faces on a given axis.
-            auto t0 = (min[i] - r.orig[i])/r.dir[i];
-            auto t1 = (max[i] - r.orig[i])/r.dir[i];
-            if(t1 < t0)
-                std::swap(t0, t1);
+            // volume's faces on a given axis. The face hit first
+            // is the `min` one if the ray goes towards positive
+            // values on this axis, and the `max` one otherwise,
+            // so that we can pick it directly with the sign of
+            // the direction instead of swapping t0 and t1; we
+            // also multiply by the inverse direction stored in
+            // the ray instead of dividing by the direction.
+            auto t0 = ((*this)[near[i]][i] - r.orig[i]) * r.inv_dir[i];
+            auto t1 = ((*this)[1 - near[i]][i] - r.orig[i]) * r.inv_dir[i];
 
             // Then intersect that interval with [tmin, tmax],
             // calculate [t0, t1] for a second axis, intersect,
-            // etc.
-            tmin = glm::max(t0, tmin);
-            tmax = glm::min(t1, tmax);
-
-            // We will eventually end up with a [tmin, tmax]
-            // interval such that tmin > tmax if there is no
-            // collision (we can easily understand why this is
-            // in two dimensions: picture a square with its
-            // sides prolonged by lines. Any ray that does not
-            // hit the square will pass through the Y-axis
-            // planes before the X-axis planes; then given that
-            // the initial [tmin, tmax] interval is big enough
-            // to contain all the time points -- which is a
-            // reasonable assumption; we are simply giving
-            // ourselves enough time to hit all t0x, t1x, t0y,
-            // t1y time points -- then the first intersection
-            // will result in [t0x, t1x]. Then, when trying to
-            // intersect with [t0y, t1y], the new interval is
-            // flipped, because t0y < t0x and t1y < t1x results
-            // in [t0x, t1y], where t1y < t0x. The reasoning
-            // stays the same in three dimensions, but with one
-            // more intersection).
-            if(tmax <= tmin)
-                return false;
+            // etc. These are written so that the compiler
+            // turns them into min/max instructions instead of
+            // branches, and so that a NaN time (when the ray
+            // origin lies on a face parallel to the direction,
+            // 0 * infinity) leaves the interval unchanged.
+            tmin = t0 > tmin ? t0 : tmin;
+            tmax = t1 < tmax ? t1 : tmax;
         }
 
-        return true;
+        // We will eventually end up with a [tmin, tmax]
+        // interval such that tmin > tmax if there is no
+        // collision (we can easily understand why this is
+        // in two dimensions: picture a square with its
+        // sides prolonged by lines. Any ray that does not
+        // hit the square will pass through the Y-axis
+        // planes before the X-axis planes; then given that
+        // the initial [tmin, tmax] interval is big enough
+        // to contain all the time points -- which is a
+        // reasonable assumption; we are simply giving
+        // ourselves enough time to hit all t0x, t1x, t0y,
+        // t1y time points -- then the first intersection
+        // will result in [t0x, t1x]. Then, when trying to
+        // intersect with [t0y, t1y], the new interval is
+        // flipped, because t0y < t0x and t1y < t1x results
+        // in [t0x, t1y], where t1y < t0x. The reasoning
+        // stays the same in three dimensions, but with one
+        // more intersection). Checking the interval once at
+        // the end rather than after each axis avoids
+        // branches that the processor can't predict.
+        return tmin < tmax;
+    }
+
+    Point3 Bounds::centroid() const
+    {
+        return (min + (max - min)*0.5f);
+    }
+
+    float Bounds::area() const
+    {
+        auto [dx, dy, dz] = max - min;
+        return 2.f*(dx*dy + dx*dz + dy*dz);
+    }
+
+    int Bounds::max_extent() const
+    {
+        auto d = max - min;
+        if(d.x > d.y && d.x > d.z)
+            return 0;
+
+        return (d.y > d.z) ? 1 : 2;
     }
 
-    Bounds surrounding_box(const Bounds& b1, const Bounds& b2)
+    Vec3 Bounds::offset(const Point3& p) const
     {
-        Point3 min { glm::min(b1.min.x, b2.min.x),
-                    glm::min(b1.min.y, b2.min.y),
-                    glm::min(b1.min.z, b2.min.z) };
+        auto o = p - min;
+        auto d = max - min;
 
-        Point3 max { glm::max(b1.max.x, b2.max.x),
-                    glm::max(b1.max.y, b2.max.y),
-                    glm::max(b1.max.z, b2.max.z) };
+        // Flat boxes have no extent to divide by on some axis: every
+        // point is then at offset 0 on that axis.
+        for (int i = 0; i < 3; ++i)
+        {
+            if(d[i] > 0.f)
+                o[i] /= d[i];
+            else
+                o[i] = 0.f;
+        }
 
-        return { min, max };
+        return o;
     }
 }
\ No newline at end of file
@@ -1,7 +1,9 @@
 
 #pragma once
 
+#include "Core.hpp"
 #include "Objects/Ray.hpp"
+#include "Utils/Math/simd.hpp"
 
 namespace Ilya
 {
@@ -20,10 +22,115 @@ namespace Ilya
             /// `tmin` and `tmax` ?
             bool hit(const Ray& r, float tmin, float tmax) const;
 
+            /// `min` for i = 0, `max` for i = 1.
+            const Point3& operator[](int i) const
+            {
+                return i ? max : min;
+            }
+
+            /// Center of the box.
+            Point3 centroid() const;
+
+            /// Total area of the six faces of the box.
+            float area() const;
+
+            /// Axis (0, 1 or 2) along which the box is the longest.
+            int max_extent() const;
+
+            /// Position of `p` relative to the box corners, that is,
+            /// 0 at `min` and 1 at `max` on each axis.
+            Vec3 offset(const Point3& p) const;
+
         public:
 
             Point3 min, max;
     };
 
-    Bounds surrounding_box(const Bounds& b1, const Bounds& b2);
+    /// @brief N bounding boxes tested at once
+    ///
+    /// The boxes are stored coordinate by coordinate (all the min.x,
+    /// then all the min.y, etc.), so that the slab test of `Bounds`
+    /// runs on the N boxes at the same time with SIMD instructions.
+    /// Unused slots hold an inverted box that no ray can hit.
+    template<int N>
+    class BoundsPack
+    {
+        public:
+
+            BoundsPack()
+            {
+                for (int i = 0; i < N; ++i)
+                    clear(i);
+            }
+
+            void set(int i, const Bounds& b)
+            {
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    min[axis][i] = b.min[axis];
+                    max[axis][i] = b.max[axis];
+                }
+            }
+
+            void clear(int i)
+            {
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    min[axis][i] = infinity;
+                    max[axis][i] = -infinity;
+                }
+            }
+
+            /// Which boxes does the ray `r` hit between `tmin` and
+            /// `tmax` ? Bit i of the result is set if box i is hit,
+            /// and `tnear` receives the entry time in each box.
+            uint32_t hit(const Ray& r, float tmin, float tmax, vfloat<N>& tnear) const
+            {
+                vfloat<N> t_min {tmin}, t_max {tmax};
+
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    // Same slab test as `Bounds::hit()`, with the near
+                    // and far faces picked from the sign of the ray
+                    // direction.
+                    const auto& near = r.dir_is_neg[axis] ? max : min;
+                    const auto& far = r.dir_is_neg[axis] ? min : max;
+
+                    vfloat<N> orig {r.orig[axis]}, inv {r.inv_dir[axis]};
+                    auto t0 = (vfloat<N>::load(near[axis]) - orig) * inv;
+                    auto t1 = (vfloat<N>::load(far[axis]) - orig) * inv;
+
+                    t_min = vmax(t_min, t0);
+                    t_max = vmin(t_max, t1);
+                }
+
+                tnear = t_min;
+                return t_min < t_max;
+            }
+
+        public:
+
+            float min[3][N];
+            float max[3][N];
+    };
+
+    // Both are called for every primitive at every level of a BVH
+    // build, so they are kept inline.
+    inline Bounds surrounding_box(const Bounds& b1, const Bounds& b2)
+    {
+        Point3 min { glm::min(b1.min.x, b2.min.x),
+                    glm::min(b1.min.y, b2.min.y),
+                    glm::min(b1.min.z, b2.min.z) };
+
+        Point3 max { glm::max(b1.max.x, b2.max.x),
+                    glm::max(b1.max.y, b2.max.y),
+                    glm::max(b1.max.z, b2.max.z) };
+
+        return { min, max };
+    }
+
+    inline Bounds surrounding_box(const Bounds& b, const Point3& p)
+    {
+        return surrounding_box(b, Bounds{p});
+    }
 }
\ No newline at end of file
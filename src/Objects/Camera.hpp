@@ -46,17 +46,30 @@ namespace Ilya
             }
 
             Ray ray(float s, float t) const
+            {
+                auto lens_u = Random::rfloat();
+                auto lens_v = Random::rfloat();
+                auto time = Random::rfloat();
+
+                return ray(s, t, {lens_u, lens_v}, time);
+            }
+
+            /// Ray through the point (s, t) of the viewport, from the
+            /// point of the lens given by the sample `lens_sample` of
+            /// the unit square, at the time given by `time_sample` in
+            /// [0, 1[.
+            Ray ray(float s, float t, const Vec2& lens_sample, float time_sample) const
             {
                 // We take a random vector on the lens border, and use
                 // that as an offset in the ray origin to simulate the
                 // effect of an actual lens.
-                auto rdv = lens * Random::in_unit_disk();
+                auto rdv = lens * Random::disk(lens_sample.x, lens_sample.y);
                 auto offset = u*rdv.x + v*rdv.y;
 
                 // The "viewport origin" is set in the lower left corner
                 // (llc) of the viewport plane.
                 return {orig + offset, llc + s*horizontal + t*vertical - orig - offset,
-                        Random::rfloat(t_open, t_close)};
+                        t_open + time_sample*(t_close - t_open)};
             }
 
         public:
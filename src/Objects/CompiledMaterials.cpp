@@ -0,0 +1,124 @@
+
+#include "CompiledMaterials.hpp"
+
+namespace Ilya
+{
+    CompiledMaterials::CompiledMaterials()
+    {
+        materials.reserve(MaterialTable::size());
+
+        for (uint32_t i = 0; i < MaterialTable::size(); ++i)
+        {
+            const auto& mat = MaterialTable::at(i);
+
+            if(auto m = dynamic_cast<const Lambertian*>(mat.get()))
+                materials.emplace_back(Textured<Lambertian>{m, compile(m->albedo)});
+            else if(auto m = dynamic_cast<const Metal*>(mat.get()))
+                materials.emplace_back(*m);
+            else if(auto m = dynamic_cast<const Dielectric*>(mat.get()))
+                materials.emplace_back(*m);
+            else if(auto m = dynamic_cast<const DiffuseLight*>(mat.get()))
+                materials.emplace_back(Textured<DiffuseLight>{m, compile(m->emitter)});
+            else if(auto m = dynamic_cast<const Isotropic*>(mat.get()))
+                materials.emplace_back(Textured<Isotropic>{m, compile(m->albedo)});
+            else
+                materials.emplace_back(mat.get());
+        }
+    }
+
+    uint32_t CompiledMaterials::compile(const Ref<Texture>& tex)
+    {
+        if(auto it = texture_indices.find(tex.get()); it != texture_indices.end())
+            return it->second;
+
+        // Checkers compile their subtextures first, so their slot is
+        // only added once the indices of the subtextures are known.
+        auto compiled = [&]() -> TextureVariant
+        {
+            if(auto t = dynamic_cast<const SolidColor*>(tex.get()))
+                return *t;
+            if(auto t = dynamic_cast<const CheckerTexture*>(tex.get()))
+                return Checker{compile(t->even), compile(t->odd)};
+            if(auto t = dynamic_cast<const NoiseTexture*>(tex.get()))
+                return t;
+            if(auto t = dynamic_cast<const ImageTexture*>(tex.get()))
+                return t;
+
+            return tex.get();
+        }();
+
+        auto idx = static_cast<uint32_t>(textures.size());
+        textures.push_back(compiled);
+        texture_indices[tex.get()] = idx;
+
+        return idx;
+    }
+
+    Color CompiledMaterials::texture(uint32_t tex, float u, float v, const Point3& p) const
+    {
+        return std::visit([&](const auto& t) -> Color
+        {
+            using T = std::decay_t<decltype(t)>;
+
+            if constexpr(std::is_same_v<T, SolidColor>)
+                return t.color;
+            else if constexpr(std::is_same_v<T, Checker>)
+                return texture(CheckerTexture::even_cell(p) ? t.even : t.odd, u, v, p);
+            else
+                return t->val(u, v, p);
+        }, textures[tex]);
+    }
+
+    Color CompiledMaterials::emitted(const HitRecord& rec) const
+    {
+        return std::visit([&](const auto& m) -> Color
+        {
+            using T = std::decay_t<decltype(m)>;
+
+            // Only the front face of lights emits (see
+            // `DiffuseLight::emitted()`).
+            if constexpr(std::is_same_v<T, Textured<DiffuseLight>>)
+                return rec.frontFace ? texture(m.texture, rec.u, rec.v, rec.p) : Color{};
+            else if constexpr(std::is_same_v<T, Metal> || std::is_same_v<T, Dielectric>)
+                return m.emitted(rec.u, rec.v, rec.p, rec);
+            else if constexpr(std::is_same_v<T, const Material*>)
+                return m->emitted(rec.u, rec.v, rec.p, rec);
+            else
+                return m.material->emitted(rec.u, rec.v, rec.p, rec);
+        }, materials[rec.material]);
+    }
+
+    bool CompiledMaterials::scatter(const Ray& in, ScatterRecord& scatter, const HitRecord& rec) const
+    {
+        return std::visit([&](const auto& m)
+        {
+            using T = std::decay_t<decltype(m)>;
+
+            if constexpr(std::is_same_v<T, Textured<Lambertian>>)
+                return Lambertian::scatter_albedo(texture(m.texture, rec.u, rec.v, rec.p), scatter, rec);
+            else if constexpr(std::is_same_v<T, Textured<Isotropic>>)
+                return Isotropic::scatter_albedo(texture(m.texture, rec.u, rec.v, rec.p), scatter);
+            else if constexpr(std::is_same_v<T, Metal> || std::is_same_v<T, Dielectric>)
+                return m.scatter(in, scatter, rec);
+            else if constexpr(std::is_same_v<T, const Material*>)
+                return m->scatter(in, scatter, rec);
+            else
+                return m.material->scatter(in, scatter, rec);
+        }, materials[rec.material]);
+    }
+
+    float CompiledMaterials::scattering_pdf(const Ray& in, const Ray& out, const HitRecord& rec) const
+    {
+        return std::visit([&](const auto& m)
+        {
+            using T = std::decay_t<decltype(m)>;
+
+            if constexpr(std::is_same_v<T, Metal> || std::is_same_v<T, Dielectric>)
+                return m.scattering_pdf(in, out, rec);
+            else if constexpr(std::is_same_v<T, const Material*>)
+                return m->scattering_pdf(in, out, rec);
+            else
+                return m.material->scattering_pdf(in, out, rec);
+        }, materials[rec.material]);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,84 @@
+
+#pragma once
+
+#include "Material.hpp"
+#include "Hittable.hpp"
+
+#include <variant>
+
+namespace Ilya
+{
+    /// @brief Flat copy of the materials of the scene
+    ///
+    /// Going through `MaterialTable`, each material call is a virtual
+    /// call, and so is each texture lookup inside it (twice for a
+    /// checker texture). Compiling the table stores the materials and
+    /// textures known to the renderer in two flat arrays of variants,
+    /// where materials refer to their textures by index: calls are then
+    /// dispatched with `std::visit` over a closed set of `final` types,
+    /// which the compiler can inline. Materials and textures of any
+    /// other type are kept as pointers and still called virtually.
+    class CompiledMaterials
+    {
+        public:
+
+            /// Compile every material of the `MaterialTable`, and the
+            /// textures they use.
+            CompiledMaterials();
+
+            /// Same as the `Material` functions, for the material of
+            /// the hit `rec`.
+            Color emitted(const HitRecord& rec) const;
+            bool scatter(const Ray& in, ScatterRecord& scatter, const HitRecord& rec) const;
+            float scattering_pdf(const Ray& in, const Ray& out, const HitRecord& rec) const;
+
+            /// Value of the compiled texture `tex` at `p`.
+            Color texture(uint32_t tex, float u, float v, const Point3& p) const;
+
+            /// Type of the material `idx`, in [0, kinds[, to group the
+            /// hits on the same type of material together.
+            uint32_t kind(uint32_t idx) const
+            {
+                return static_cast<uint32_t>(materials[idx].index());
+            }
+
+        private:
+
+            /// Material whose texture is given by its index in the
+            /// compiled textures.
+            template<typename M>
+            struct Textured
+            {
+                const M* material;
+                uint32_t texture;
+            };
+
+            /// Checker texture whose subtextures are given by their
+            /// index in the compiled textures.
+            struct Checker
+            {
+                uint32_t even, odd;
+            };
+
+            using MaterialVariant = std::variant<Textured<Lambertian>, Metal, Dielectric,
+                                                 Textured<DiffuseLight>, Textured<Isotropic>,
+                                                 const Material*>;
+
+            using TextureVariant = std::variant<SolidColor, Checker, const NoiseTexture*,
+                                                const ImageTexture*, const Texture*>;
+
+        public:
+
+            static constexpr auto kinds = static_cast<uint32_t>(std::variant_size_v<MaterialVariant>);
+
+        private:
+
+            /// Index of `tex` in the compiled textures, compiling it
+            /// (and its subtextures) if it isn't there yet.
+            uint32_t compile(const Ref<Texture>& tex);
+
+            std::vector<MaterialVariant> materials;
+            std::vector<TextureVariant> textures;
+            std::unordered_map<const Texture*, uint32_t> texture_indices;
+    };
+}
\ No newline at end of file
@@ -3,9 +3,34 @@
 
 #include "Utils/Math/geometry.hpp"
 #include "Utils/Math/functions.hpp"
+#include "Core/Parallel.hpp"
+
+#include <bit>
+#include <chrono>
+#include <thread>
 
 namespace Ilya
 {
+    bool Hittable::sample_light(const Point3& origin, float time, LightSample& sample) const
+    {
+        auto p = random_point(origin);
+        Vec3 v {p.x, p.y, p.z};
+
+        sample.distance = length(v);
+        if(sample.distance == 0.f)
+            return false;
+
+        sample.dir = v/sample.distance;
+        sample.pdf = pdf_value({origin, sample.dir, time});
+
+        return sample.pdf > 0.f;
+    }
+
+    bool Hittable::occluded(const Ray& r, float tmin, float tmax) const
+    {
+        HitRecord rec {};
+        return hit(r, tmin, tmax, rec);
+    }
 
     bool HittableList::hit(const Ray& r, float tmin, float tmax, HitRecord& rec) const
     {
@@ -38,6 +63,19 @@ namespace Ilya
         return hit;
     }
 
+    bool HittableList::occluded(const Ray& r, float tmin, float tmax) const
+    {
+        // Unlike `hit()`, the range never shrinks: the first object
+        // hit anywhere in it is the answer.
+        for (const auto& obj: objects)
+        {
+            if(obj->occluded(r, tmin, tmax))
+                return true;
+        }
+
+        return false;
+    }
+
     bool HittableList::bounds(Bounds& box, float t0, float t1) const
     {
         if(objects.empty())
@@ -66,7 +104,7 @@ namespace Ilya
         return objects[index]->random_point(origin);
     }
 
-    float HittableList::pdf_value(const Ray& r)
+    float HittableList::pdf_value(const Ray& r) const
     {
         // Sum the probability values for every object in the list and
         // return it normalized.
@@ -80,6 +118,43 @@ namespace Ilya
         return sum/objects.size();
     }
 
+    float HittableList::power() const
+    {
+        auto sum = 0.f;
+        for (auto& obj: objects)
+            sum += obj->power();
+
+        return sum;
+    }
+
+    bool HittableList::light_bounds(LightBounds& light) const
+    {
+        bool found = false;
+
+        for (auto& obj: objects)
+        {
+            LightBounds objlight {};
+            if(!obj->light_bounds(objlight))
+                continue;
+
+            light = found ? surrounding_light(light, objlight) : objlight;
+            found = true;
+        }
+
+        return found;
+    }
+
+    /// Power emitted by a surface of area `area` with the material
+    /// `material`, which emits from its front face only.
+    static float emitted_power(uint32_t material, float area)
+    {
+        const auto& mat = MaterialTable::at(material);
+        if(!mat)
+            return 0.f;
+
+        return pi * area * luminance(mat->emission());
+    }
+
     bool Sphere::hit(const Ray& r, float tmin, float tmax, HitRecord& rec) const
     {
         // How do we detect if a ray hits a sphere ? Let's say the ray
@@ -92,6 +167,31 @@ namespace Ilya
         // (A + tB - C)^2 = R^2 <=> (tB)^2 + 2tB(A-C) + (A-C)^2 - R^2 = 0,
         // which is simply a quadratic equation in t. The solutions of this
         // equation are the times at which the ray hits the sphere.
+        float root;
+        if(!nearest_root(r, tmin, tmax, root))
+            return false;
+
+        // Once we got the solution, we save it in the hit record,
+        // which will allow us to use that data later
+        rec.t = root;
+        rec.p = r(rec.t);
+        rec.normal = (rec.p - center(r.cast_time))/radius;
+        rec.material = material;
+        auto out_normal = (rec.p - center(r.cast_time))/radius;
+        rec.face_normal(r, out_normal);
+        std::tie(rec.u, rec.v) = sphere_uv(out_normal);
+
+        return true;
+    }
+
+    bool Sphere::occluded(const Ray& r, float tmin, float tmax) const
+    {
+        float root;
+        return nearest_root(r, tmin, tmax, root);
+    }
+
+    bool Sphere::nearest_root(const Ray& r, float tmin, float tmax, float& t) const
+    {
         auto oc = r.orig - center(r.cast_time);
         auto a = dot(r.dir, r.dir);
         auto b = 2 * dot(r.dir, oc);
@@ -102,28 +202,18 @@ namespace Ilya
             return false;
 
         auto sqrtd = std::sqrt(discriminant);
-        auto root = (-b - sqrtd)/(2*a);
+        t = (-b - sqrtd)/(2*a);
 
         // We want the solution to be within the cast_time
         // range [tmin,tmax].
-        if(root < tmin || root > tmax)
+        if(t < tmin || t > tmax)
         {
-            root = (-b + sqrtd)/(2*a);
+            t = (-b + sqrtd)/(2*a);
 
-            if(root < tmin || root > tmax)
+            if(t < tmin || t > tmax)
                 return false;
         }
 
-        // Once we got the solution, we save it in the hit record,
-        // which will allow us to use that data later
-        rec.t = root;
-        rec.p = r(rec.t);
-        rec.normal = (rec.p - center(r.cast_time))/radius;
-        rec.material = material;
-        auto out_normal = (rec.p - center(r.cast_time))/radius;
-        rec.face_normal(r, out_normal);
-        std::tie(rec.u, rec.v) = sphere_uv(out_normal);
-
         return true;
     }
 
@@ -143,10 +233,54 @@ namespace Ilya
         return true;
     }
 
+    /// 1 - cos(theta_max) for a cone of half-angle theta_max such that
+    /// sin^2(theta_max) = `sin2`. For narrow cones (far or small
+    /// spheres), cos(theta_max) is so close to 1 that the difference
+    /// would be mostly rounding error, and its Taylor expansion is
+    /// used instead.
+    static float one_minus_cos(float sin2)
+    {
+        return sin2 < 0.00068523f ? sin2/2 : 1 - std::sqrt(1 - sin2);
+    }
+
     Point3 Sphere::random_point(const Point3& origin) const
     {
-        auto dir = c0 - origin;
-        auto d = length(dir);
+        LightSample sample {};
+        if(!sample_light(origin, t0, sample))
+            return Point3{c0 - origin};
+
+        return Point3{sample.dir*sample.distance};
+    }
+
+    bool Sphere::sample_light(const Point3& origin, float time, LightSample& sample) const
+    {
+        auto c = center(time);
+        auto oc = c - origin;
+        auto d2 = square(oc);
+        auto radius2 = radius*radius;
+
+        // From inside the sphere, it is seen in every direction: pick
+        // a point uniformly on its surface, and change the density per
+        // unit of area 1/A into a density per unit of solid angle (see
+        // `Rectangle::pdf_value()`).
+        if(d2 <= radius2)
+        {
+            auto n = Random::unit_vector();
+            auto v = (c + radius*n) - origin;
+            auto dist2 = square(v);
+            if(dist2 == 0.f)
+                return false;
+
+            sample.distance = std::sqrt(dist2);
+            sample.dir = v/sample.distance;
+
+            auto cos = std::abs(dot(sample.dir, n));
+            if(cos == 0.f)
+                return false;
+
+            sample.pdf = dist2/(cos*4*pi*radius2);
+            return true;
+        }
 
         // To get a random point on the surface of the sphere, we get
         // two random numbers, which we use for the angles theta and phi...
@@ -157,28 +291,26 @@ namespace Ilya
         // ...and then transform to cartesian coordinates. We have that
         // r2 = Integral{2pi*f(u)*sin(t)} (see `Random::cosine_dir()`),
         // with f(u) = C a constant because we are sampling uniformly
-        // over the sphere, and with r2 = 1 at theta = theta_max, so in
-        // the end cos(t) = 1 + r2*(cos(t_max) - 1). But sin(t_max),
-        // geometrically, is the ratio between the radius of the sphere
-        // and the distance from the viewer to the center of the sphere,
-        // that is, sin(t_max) = r/d. Then cos(t_max) = sqrt(1 - sin^2),
-        // and transforming from spherical coordinates give us x, y and
-        // z.
-        auto cos_t_max = std::sqrt(1 - radius*radius/(d*d));
-        auto z = 1 + r2*(cos_t_max - 1);
-        auto x = std::cos(phi)*std::sqrt(1 - z*z);
-        auto y = std::sin(phi)*std::sqrt(1 - z*z);
-
-        ONB uvw {dir};
-        return Point3{uvw.local(x, y, z)};
-    }
-
-    float Sphere::pdf_value(const Ray& r)
-    {
-        // Check that the ray hits the sphere; if not, the PDF value is 0.
-        HitRecord rec {};
-        if(!hit(r, 0.001, infinity, rec))
-            return 0.f;
+        // over the cone under which the sphere is seen, and with r2 = 1
+        // at theta = theta_max, so in the end cos(t) = 1 + r2*(cos(t_max)
+        // - 1). But sin(t_max), geometrically, is the ratio between the
+        // radius of the sphere and the distance from the viewer to the
+        // center of the sphere, that is, sin(t_max) = r/d. We keep
+        // 1 - cos(t) rather than cos(t), for precision on narrow cones.
+        auto max = one_minus_cos(radius2/d2);
+        auto x = r2*max;
+        auto cos_t = 1 - x;
+        auto sin2_t = x*(2 - x);
+        auto sin_t = std::sqrt(sin2_t);
+
+        // The point hit in that direction is on the near side of the
+        // sphere, at the distance given by the law of cosines in the
+        // triangle formed by the origin, the center and the point.
+        auto d = std::sqrt(d2);
+        sample.distance = d*cos_t - std::sqrt(std::max(radius2 - d2*sin2_t, 0.f));
+
+        ONB uvw {oc};
+        sample.dir = uvw.local(std::cos(phi)*sin_t, std::sin(phi)*sin_t, cos_t);
 
         // The probability of hitting the sphere of a certain radius at
         // a certain distance is the inverse of the solid angle through
@@ -186,104 +318,396 @@ namespace Ilya
         // one unit of the surface of the sphere seen by the viewer",
         // which is precisely the solid angle). Then, knowing that the
         // solid angle is given by the integral over theta and phi at a
-        // constant radius, W = Integral{sin(theta)} = 2*pi*(1 - cos(t_max))
-        // and calculating cos(t_max) as described in `random_point()`,
+        // constant radius, W = Integral{sin(theta)} = 2*pi*(1 - cos(t_max)),
         // we get the result.
-        auto d = length(center(rec.t) - r.orig);
-        auto cos_t_max = std::sqrt(1 - radius*radius/(d*d));
-        auto solid_angle = 2*pi*(1 - cos_t_max);
+        sample.pdf = 1/(2*pi*max);
 
-        return 1/solid_angle;
+        return true;
     }
 
-    /// Return whether the hittable `a` is to the left (true) or the
-    /// right (false) of `b` on the axis N.
-    template<unsigned N> requires (N < 3)
-    inline bool box_compare(const Ref<Hittable>& a, const Ref<Hittable>& b)
+    float Sphere::pdf_value(const Ray& r) const
     {
-        // Compare two boxes.
-        Bounds box_a {}, box_b {};
+        auto c = center(r.cast_time);
+        auto oc = c - r.orig;
+        auto d2 = square(oc);
+        auto radius2 = radius*radius;
+        auto dir2 = square(r.dir);
+
+        if(d2 <= radius2)
+        {
+            // From inside, the ray hits the sphere on the far root of
+            // the quadratic of `hit()`, which gives the distance and
+            // the cosine to convert the density per unit of area.
+            auto half_b = dot(r.dir, oc);
+            auto t = (half_b + std::sqrt(half_b*half_b + dir2*(radius2 - d2)))/dir2;
+
+            auto v = r.dir*t;
+            auto dist2 = square(v);
+            auto cos = std::abs(dot(v - oc, v))/(radius*std::sqrt(dist2));
+            if(dist2 == 0.f || cos == 0.f)
+                return 0.f;
+
+            return dist2/(cos*4*pi*radius2);
+        }
 
-        // First check if the hittables `a` and `b` actually have bounding
-        // boxes (that is, if one or both of them are not empty).
-        if(!a->bounds(box_a, 0, 0) || !b->bounds(box_b, 0, 0))
-            error("No bounding box in BVHnode constructor.\n");
+        // From outside, the ray hits the sphere if it goes towards its
+        // center and passes closer to it than its radius, which needs
+        // no intersection; it is then in the cone of `sample_light()`,
+        // which has a uniform density. The distance to the center is
+        // taken from a cross product: for far spheres, subtracting the
+        // squared distance along the ray from d^2 would lose all the
+        // precision.
+        if(dot(oc, r.dir) <= 0.f || square(cross(oc, r.dir)) > radius2*dir2)
+            return 0.f;
+
+        return 1/(2*pi*one_minus_cos(radius2/d2));
+    }
 
-        // Then, compare: on the axis N, is the surrounding box of `a`
-        // more to the left than that of `b` ?
-        return box_a.min[N] < box_b.min[N];
+    float Sphere::power() const
+    {
+        return emitted_power(material, 4*pi*radius*radius);
     }
 
-    BVHnode::BVHnode(const std::vector<Ref<Hittable>>& objs, size_t start,
+    BVHnode::BVHnode(const std::vector<Ref<Hittable>>& objects, size_t start,
                      size_t end, float t0, float t1)
     {
+        auto begin = std::chrono::steady_clock::now();
+
         // The bounding volume hierarchy (BVH) is a structure that
         // constructs a tree from a set of objects, by dividing space
         // recursively in "left" and "right" boxes, which contain
-        // objects of the scene. To do so, we need a comparator
-        // function, which works on a per-axis basis: the axis is chosen
-        // randomly as the constructor keeps being called when
-        // constructing the tree (in other words, node splitting is done
-        // each time along one random axis).
-        auto objects = objs;
-        auto axis = Random::uint(0, 2);
-        auto comparator = (axis == 0) ? box_compare<0>
-                                      : (axis == 1) ? box_compare<1>
-                                                    : box_compare<2>;
-
-        size_t span = end - start;
-        if(span == 1)
+        // objects of the scene. Building it only needs the bounds of
+        // each object and their centers, which we compute once here
+        // (calling `bounds()` on the objects is a virtual call, and
+        // can be costly for composite objects) and then move around
+        // while splitting the objects between the nodes. For large
+        // scenes, the objects are processed in blocks spread over all
+        // the threads.
+        std::vector<BVHprimitive> prims(end - start);
+
+        constexpr uint32_t block_size = 4096;
+        auto blocks = static_cast<uint32_t>((prims.size() + block_size - 1)/block_size);
+
+        parallel_for(blocks, [&](uint32_t block)
         {
-            // If there is only one object left, there is only one leaf
-            // in this branch of the tree.
-            left = right = objects[start];
+            auto first = size_t(block)*block_size;
+            auto last = std::min(first + block_size, prims.size());
+
+            for (auto i = first; i < last; ++i)
+            {
+                Bounds box {};
+                if(!objects[start + i]->bounds(box, t0, t1))
+                    error("No bounding box in BVHnode constructor.\n");
+
+                prims[i] = {box, box.centroid(), static_cast<uint32_t>(start + i)};
+            }
+        });
+
+        if(!prims.empty())
+            build(objects, prims, 0, prims.size(), hardware_threads(), 0);
+
+        auto elapsed = std::chrono::steady_clock::now() - begin;
+        build_ms = std::chrono::duration<float, std::milli>(elapsed).count();
+    }
+
+    /// Bounds of the primitives of a node and of their centroids, and
+    /// the bins of their centroids on each axis, gathered in a single
+    /// pass over a range of primitives.
+    struct BVHbins
+    {
+        static constexpr auto bins = BVHnode::bins;
+
+        Bounds box {Point3{infinity}, Point3{-infinity}};
+        Bounds centroids {Point3{infinity}, Point3{-infinity}};
+        Bounds bin_box[3][bins];
+        uint32_t bin_count[3][bins] {};
+
+        /// Add the bounds of the primitives of `prims` in [start, end[
+        /// to `box` and `centroids`.
+        void add_bounds(const std::vector<BVHprimitive>& prims, size_t start, size_t end)
+        {
+            for (auto i = start; i < end; ++i)
+            {
+                box = surrounding_box(box, prims[i].box);
+                centroids = surrounding_box(centroids, prims[i].centroid);
+            }
         }
-        else if(span == 2)
+
+        /// Put the primitives of `prims` in [start, end[ in the bins
+        /// given by `bin_index`, on every axis at once.
+        void add_bins(const std::vector<BVHprimitive>& prims, size_t start, size_t end,
+                      const auto& bin_index)
         {
-            // If there are 2 objects, we can compare them directly:
-            if(comparator(objects[start], objects[start + 1]))
+            for (auto i = start; i < end; ++i)
             {
-                // If the comparator returns true, the first parameter is
-                // the left leaf and the second parameter the right leaf.
-                left = objects[start];
-                right = objects[start + 1];
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    auto b = bin_index(prims[i], axis);
+                    bin_box[axis][b] = bin_count[axis][b] ? surrounding_box(bin_box[axis][b], prims[i].box)
+                                                          : prims[i].box;
+                    ++bin_count[axis][b];
+                }
             }
-            else
+        }
+
+        void merge_bounds(const BVHbins& other)
+        {
+            box = surrounding_box(box, other.box);
+            centroids = surrounding_box(centroids, other.centroids);
+        }
+
+        void merge_bins(const BVHbins& other)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                for (uint32_t b = 0; b < bins; ++b)
+                {
+                    if(!other.bin_count[axis][b])
+                        continue;
+
+                    bin_box[axis][b] = bin_count[axis][b] ? surrounding_box(bin_box[axis][b], other.bin_box[axis][b])
+                                                          : other.bin_box[axis][b];
+                    bin_count[axis][b] += other.bin_count[axis][b];
+                }
+            }
+        }
+    };
+
+    BVHsplit BVHnode::split(std::vector<BVHprimitive>& prims, size_t start,
+                            size_t end, uint32_t threads, uint32_t depth,
+                            uint32_t max_leaf, uint32_t width)
+    {
+        auto count = end - start;
+
+        // Splitting a range at its median halves it, so that its
+        // primitives end up alone in their leaves after
+        // bit_width(count - 1) more levels. Once that would take the
+        // tree past `max_depth`, the SAH is given up for median splits,
+        // which bounds the depth whatever the primitives look like.
+        bool median = count > 0 && depth + std::bit_width(count - 1) >= max_depth;
+
+        // Large nodes (the ones near the root) are built with several
+        // threads: each one gathers the bounds and bins of a chunk of
+        // the primitives, which are then merged. Smaller nodes are
+        // processed by a single thread, since they are already built
+        // in parallel with the rest of the tree (see `build()`).
+        auto chunks = (threads > 1 && count >= parallel_build_size) ? threads : 1u;
+        auto chunk_start = [&](uint32_t c) { return start + count*c/chunks; };
+
+        BVHbins node_bins {};
+        auto collect = [&](auto pass, auto merge)
+        {
+            if(chunks == 1)
             {
-                // If it returns false, it is the other way around.
-                left = objects[start + 1];
-                right = objects[start];
+                pass(node_bins, start, end);
+                return;
             }
+
+            std::vector<BVHbins> chunk_bins(chunks);
+            parallel_for(chunks, [&](uint32_t c)
+            {
+                pass(chunk_bins[c], chunk_start(c), chunk_start(c + 1));
+            }, chunks);
+
+            for (const auto& other: chunk_bins)
+                merge(node_bins, other);
+        };
+
+        // The node box surrounds all of its primitives; we also need
+        // the box surrounding their centers, which is the range over
+        // which we look for a split position.
+        collect([&](BVHbins& bins, size_t first, size_t last) { bins.add_bounds(prims, first, last); },
+               [](BVHbins& bins, const BVHbins& other) { bins.merge_bounds(other); });
+
+        BVHsplit result {node_bins.box};
+        const auto& box = result.box;
+        const auto& centroids = node_bins.centroids;
+
+        // Where to split the node ? The surface area heuristic (SAH)
+        // estimates the cost of a split from the probability for a
+        // ray that hits the node to also hit each child, which is the
+        // ratio of their surface areas (for uniformly distributed
+        // rays), so that the cost of a split into children A and B is
+        // C = C_trav + (N_A*S_A + N_B*S_B)/S, with N the number of
+        // primitives and S the area of each box. Trying every possible
+        // split would be too slow, so the centroid range is divided in
+        // a number of bins on each axis, primitives are put in the bin
+        // their centroid falls into, and we only try splitting between
+        // bins.
+        auto inv_area = (box.area() > 0.f) ? 1.f/box.area() : 0.f;
+
+        auto best_cost = infinity;
+        int best_axis = -1;
+        uint32_t best_bin = 0;
+
+        // When the primitives are intersected by groups of `width`
+        // at once, a group costs as much as a single primitive.
+        auto groups = [width](uint32_t n) { return float((n + width - 1)/width); };
+
+        // If all the centroids are at the same position on an axis,
+        // there is nothing to split on it: every primitive falls in
+        // the first bin. So it is when they are only a few rounding
+        // errors apart, or so close that bins/extent overflows.
+        float bin_scale[3];
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            auto extent = centroids.max[axis] - centroids.min[axis];
+            auto scale = bins/extent;
+            auto magnitude = std::max(std::abs(centroids.min[axis]), std::abs(centroids.max[axis]));
+            bin_scale[axis] = (extent > 1e-6f*magnitude && std::isfinite(scale)) ? scale : 0.f;
+        }
+
+        auto bin_index = [&](const BVHprimitive& prim, int axis)
+        {
+            auto b = (prim.centroid[axis] - centroids.min[axis])*bin_scale[axis];
+            return static_cast<uint32_t>(std::clamp(b, 0.f, float(bins - 1)));
+        };
+
+        if(count > 1 && !median)
+        {
+            collect([&](BVHbins& bins, size_t first, size_t last) { bins.add_bins(prims, first, last, bin_index); },
+                   [](BVHbins& bins, const BVHbins& other) { bins.merge_bins(other); });
+        }
+
+        for (int axis = 0; count > 1 && !median && axis < 3; ++axis)
+        {
+            if(bin_scale[axis] == 0.f)
+                continue;
+
+            const auto& bin_box = node_bins.bin_box[axis];
+            const auto& bin_count = node_bins.bin_count[axis];
+
+            // Sweep the bins from the right to get the area and count
+            // of every possible right side...
+            float right_area[bins] {};
+            uint32_t right_count[bins] {};
+            Bounds right {};
+            uint32_t n = 0;
+            for (auto b = bins - 1; b > 0; --b)
+            {
+                if(bin_count[b])
+                {
+                    right = n ? surrounding_box(right, bin_box[b]) : bin_box[b];
+                    n += bin_count[b];
+                }
+
+                right_area[b] = n ? right.area() : 0.f;
+                right_count[b] = n;
+            }
+
+            // ...then from the left, evaluating the split after each
+            // bin.
+            Bounds left {};
+            n = 0;
+            for (uint32_t b = 0; b < bins - 1; ++b)
+            {
+                if(bin_count[b])
+                {
+                    left = n ? surrounding_box(left, bin_box[b]) : bin_box[b];
+                    n += bin_count[b];
+                }
+
+                if(n == 0 || right_count[b + 1] == 0)
+                    continue;
+
+                auto cost = traversal_cost + (groups(n)*left.area() + groups(right_count[b + 1])*right_area[b + 1])*inv_area;
+                if(cost < best_cost)
+                {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_bin = b;
+                }
+            }
+        }
+
+        // Intersecting all the primitives of a leaf costs N_A*C_isect
+        // (with C_isect = 1, our unit of cost); if that is cheaper than
+        // the best split, and the node is small enough, it becomes a
+        // leaf. Small nodes whose primitives all have the same center
+        // cannot be split and become leaves as well.
+        if(count <= max_leaf && (median || best_axis < 0 || groups(static_cast<uint32_t>(count)) <= best_cost))
+        {
+            result.leaf = true;
+            return result;
+        }
+
+        // Larger ones are split in two halves by count along the
+        // longest axis of the centroids (which is any axis if they all
+        // coincide), as are the nodes that are too deep for the SAH.
+        if(median || best_axis < 0)
+        {
+            auto axis = centroids.max_extent();
+            auto mid = prims.begin() + start + count/2;
+            std::nth_element(prims.begin() + start, mid, prims.begin() + end,
+                             [axis](const BVHprimitive& a, const BVHprimitive& b)
+                             {
+                                 return a.centroid[axis] < b.centroid[axis];
+                             });
+
+            result.axis = axis;
+            result.mid = static_cast<size_t>(mid - prims.begin());
+
+            return result;
         }
-        else
+
+        // Partition the primitives in place around the split.
+        auto mid = std::partition(prims.begin() + start, prims.begin() + end,
+                                  [&](const BVHprimitive& prim)
+                                  {
+                                      return bin_index(prim, best_axis) <= best_bin;
+                                  });
+
+        result.axis = best_axis;
+        result.mid = static_cast<size_t>(mid - prims.begin());
+
+        return result;
+    }
+
+    void BVHnode::build(const std::vector<Ref<Hittable>>& objects,
+                        std::vector<BVHprimitive>& prims, size_t start,
+                        size_t end, uint32_t threads, uint32_t depth)
+    {
+        auto count = end - start;
+        auto s = split(prims, start, end, threads, depth);
+
+        box = s.box;
+        if(s.leaf)
         {
-            // For lists of 3 or more objects, we work with a top-down
-            // method to construct the BVH tree: first sort the objects
-            // using the comparator (so that the array ordering matches
-            // the spatial ordering), split the tree in two nodes, and
-            // repeat until all cases have been covered (that is, until
-            // the if clauses are reduced to the 1- or 2-object cases).
-            // Eventually, we are left with the leftmost and rightmost
-            // objects of the scene as the 'left' and 'right' leaves.
-            std::sort(objects.begin() + start, objects.begin() + end, comparator);
-
-            auto half = start + span/2;
-            left = std::make_shared<BVHnode>(objects, start, half, t0, t1);
-            right = std::make_shared<BVHnode>(objects, half, end, t0, t1);
+            leaf.reserve(count);
+            for (auto i = start; i < end; ++i)
+                leaf.push_back(objects[prims[i].index]);
+
+            return;
         }
 
-        // Once the left and right nodes are found, check that they are
-        // not empty...
-        Bounds box_left {}, box_right {};
-        if(!left->bounds(box_left, t0, t1)
-           || !right->bounds(box_right, t0, t1))
+        // Build the children on each side of the split.
+        axis = s.axis;
+        auto half = s.mid;
+
+        left = Ref<BVHnode>(new BVHnode);
+        right = Ref<BVHnode>(new BVHnode);
+
+        if(threads == 1 || count < parallel_build_size)
         {
-            error("No bounding box in BVHnode constructor.");
+            left->build(objects, prims, start, half, 1, depth + 1);
+            right->build(objects, prims, half, end, 1, depth + 1);
+            return;
         }
 
-        // ...and create the BVH tree surrounding box from the left and
-        // right boxes.
-        box = surrounding_box(box_left, box_right);
+        // The two children work on disjoint ranges of primitives, so
+        // they can be built at the same time: the left one is built on
+        // a new thread while this one builds the right one, the
+        // threads being shared between them in proportion to their
+        // number of primitives.
+        auto left_threads = static_cast<uint32_t>(std::lround(float(threads)*(half - start)/count));
+        left_threads = std::clamp(left_threads, 1u, threads - 1);
+
+        std::jthread worker {[&]
+        {
+            left->build(objects, prims, start, half, left_threads, depth + 1);
+        }};
+
+        right->build(objects, prims, half, end, threads - left_threads, depth + 1);
     }
 
     bool BVHnode::hit(const Ray& r, float tmin, float tmax, HitRecord& rec) const
@@ -293,6 +717,23 @@ namespace Ilya
         if(!box.hit(r, tmin, tmax))
             return false;
 
+        if(!left)
+        {
+            // In a leaf, check every object, reducing the range each
+            // time an object is hit (see `HittableList::hit()`).
+            bool hit = false;
+            for (const auto& obj: leaf)
+            {
+                if(obj->hit(r, tmin, tmax, rec))
+                {
+                    hit = true;
+                    tmax = rec.t;
+                }
+            }
+
+            return hit;
+        }
+
         // If the ray hits the left node in the given time interval, the
         // maximum time at which the right node could be hit is the time
         // at which the left node has been (that is, `rec.t`): a ray
@@ -304,12 +745,73 @@ namespace Ilya
         return hit_left || hit_right;
     }
 
+    bool BVHnode::occluded(const Ray& r, float tmin, float tmax) const
+    {
+        if(!box.hit(r, tmin, tmax))
+            return false;
+
+        if(!left)
+        {
+            for (const auto& obj: leaf)
+            {
+                if(obj->occluded(r, tmin, tmax))
+                    return true;
+            }
+
+            return false;
+        }
+
+        // Any hit will do, so the right node is only visited if
+        // nothing was found on the left.
+        return left->occluded(r, tmin, tmax) || right->occluded(r, tmin, tmax);
+    }
+
     bool BVHnode::bounds(Bounds& box, float t0, float t1) const
     {
         box = this->box;
         return true;
     }
 
+    BVHstats BVHnode::stats() const
+    {
+        BVHstats stats {build_ms, 0, 0, 0, 0, 0.f};
+        gather(stats, 1, box.area());
+
+        return stats;
+    }
+
+    void BVHnode::gather(BVHstats& stats, uint32_t depth, float root_area) const
+    {
+        // The SAH cost of the whole tree is the sum of the cost of
+        // each node (traversal for inner nodes, intersections for
+        // leaves), weighted by the probability for a ray hitting the
+        // root to reach it.
+        auto weight = (root_area > 0.f) ? box.area()/root_area : 1.f;
+
+        ++stats.nodes;
+        stats.max_depth = std::max(stats.max_depth, depth);
+
+        if(!left)
+        {
+            ++stats.leaves;
+            stats.primitives += leaf.size();
+            stats.sah_cost += weight * leaf.size();
+
+            return;
+        }
+
+        stats.sah_cost += weight * traversal_cost;
+        left->gather(stats, depth + 1, root_area);
+        right->gather(stats, depth + 1, root_area);
+    }
+
+    void BVHnode::report() const
+    {
+        auto s = stats();
+        print("BVH: {} primitives, {} nodes ({} leaves), depth {}, SAH cost {:.2f}, built in {:.2f} ms\n",
+              s.primitives, s.nodes, s.leaves, s.max_depth, s.sah_cost, s.build_ms);
+    }
+
     template<Axis ax0, Axis ax1>
     concept XY = (ax0 == Axis::X && ax1 == Axis::Y);
 
@@ -378,6 +880,24 @@ namespace Ilya
         return true;
     }
 
+    template<Axis ax0, Axis ax1> requires (ax0 < ax1)
+    bool Rectangle<ax0, ax1>::occluded(const Ray& r, float tmin, float tmax) const
+    {
+        // The same test as `hit()`, without the UV coordinates and the
+        // normal.
+        constexpr auto axis0 = static_cast<int>(ax0), axis1 = static_cast<int>(ax1);
+        constexpr auto normal_axis = 3 - axis0 - axis1;
+
+        auto t = (k - r.orig[normal_axis])/r.dir[normal_axis];
+        if(t < tmin || t > tmax)
+            return false;
+
+        auto x = r.orig[axis0] + t*r.dir[axis0];
+        auto y = r.orig[axis1] + t*r.dir[axis1];
+
+        return x >= r0 && x <= r1 && y >= s0 && y <= s1;
+    }
+
     template<Axis ax0, Axis ax1>
     requires (ax0 < ax1)bool
     Rectangle<ax0, ax1>::bounds(Bounds& box, float t0,
@@ -413,16 +933,25 @@ namespace Ilya
 
     template<Axis ax0, Axis ax1>
     requires (ax0 < ax1)
-    float Rectangle<ax0, ax1>::pdf_value(const Ray& r)
+    float Rectangle<ax0, ax1>::pdf_value(const Ray& r) const
     {
         // Check that the ray hits the rectangle (in other words, that
         // it is directed towards it): if it doesn't, return 0, because
         // we want this PDF to be a random distribution directed at this
         // rectangle (a light, for example, which we will want to
         // "attract" rays, in order to avoid repetitive and noisy ray
-        // bounces around the box).
-        HitRecord rec;
-        if(!hit(r, 0.001, infinity, rec))
+        // bounces around the box). Only the time and the position of
+        // the hit are needed, as in `hit()`, not a whole hit record.
+        constexpr auto axis0 = static_cast<int>(ax0), axis1 = static_cast<int>(ax1);
+        constexpr auto normal_axis = 3 - axis0 - axis1;
+
+        auto t = (k - r.orig[normal_axis])/r.dir[normal_axis];
+        if(!(t > 0.001f))
+            return 0.f;
+
+        auto x = r.orig[axis0] + t*r.dir[axis0];
+        auto y = r.orig[axis1] + t*r.dir[axis1];
+        if(x < r0 || x > r1 || y < s0 || y > s1)
             return 0.f;
 
         // If it does hit the rectangle, we need the PDF for the random
@@ -441,10 +970,66 @@ namespace Ilya
         // both probabilities must be the same, so pdf_val*dw = dA/A and
         // finally pdf_val = d^2/(cos(alpha)*A).
         auto area = (r1-r0)*(s1-s0);
-        auto d = rec.t * length(r.dir);
-        auto cos = std::abs(dot(r.dir, rec.normal) / length(r.dir));
+        auto dir2 = square(r.dir);
+        auto cos = std::abs(r.dir[normal_axis])/std::sqrt(dir2);
+
+        return t*t*dir2/(cos*area);
+    }
+
+    template<Axis ax0, Axis ax1>
+    requires (ax0 < ax1)
+    bool Rectangle<ax0, ax1>::sample_light(const Point3& origin, float, LightSample& sample) const
+    {
+        // A uniform point of the rectangle, whose density per unit of
+        // area is converted as in `pdf_value()`.
+        constexpr auto axis0 = static_cast<int>(ax0), axis1 = static_cast<int>(ax1);
+        constexpr auto normal_axis = 3 - axis0 - axis1;
+
+        Point3 p {};
+        p[axis0] = Random::rfloat(r0, r1);
+        p[axis1] = Random::rfloat(s0, s1);
+        p[normal_axis] = k;
+
+        auto v = p - origin;
+        auto dist2 = square(v);
+        if(dist2 == 0.f)
+            return false;
+
+        sample.distance = std::sqrt(dist2);
+        sample.dir = v/sample.distance;
+
+        auto cos = std::abs(sample.dir[normal_axis]);
+        if(cos == 0.f)
+            return false;
+
+        sample.pdf = dist2/(cos*(r1 - r0)*(s1 - s0));
+        return true;
+    }
 
-        return d*d/(cos*area);
+    template<Axis ax0, Axis ax1>
+    requires (ax0 < ax1)
+    float Rectangle<ax0, ax1>::power() const
+    {
+        return emitted_power(material, (r1 - r0)*(s1 - s0));
+    }
+
+    template<Axis ax0, Axis ax1>
+    requires (ax0 < ax1)
+    bool Rectangle<ax0, ax1>::light_bounds(LightBounds& light) const
+    {
+        Bounds box {};
+        bounds(box, 0.f, 1.f);
+
+        Vec3 w {};
+        if constexpr(XY<ax0, ax1>)
+            w = {0.f, 0.f, 1.f};
+        else if constexpr(XZ<ax0, ax1>)
+            w = {0.f, 1.f, 0.f};
+        else if constexpr(YZ<ax0, ax1>)
+            w = {1.f, 0.f, 0.f};
+
+        light = {box, power(), w, 1.f, 0.f};
+        return true;
     }
 
     using Axis::X, Axis::Y, Axis::Z;
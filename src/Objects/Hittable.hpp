@@ -6,6 +6,7 @@
 #include "Ray.hpp"
 #include "Material.hpp"
 #include "Bounds.hpp"
+#include "LightBounds.hpp"
 
 namespace Ilya
 {
@@ -13,7 +14,8 @@ namespace Ilya
     /// hit the surface (p), the normal to the surface at this point
     /// (normal), the time of impact (t), the UV coordinates of the
     /// surface at this point (u, v), whether it is a front face or not
-    /// (frontFace), and the surface's material (material).
+    /// (frontFace), and the index of the surface's material in the
+    /// `MaterialTable` (material).
     struct HitRecord
     {
         Point3 p;
@@ -21,7 +23,7 @@ namespace Ilya
         float t;
         float u, v;
         bool frontFace;
-        Ref<Material> material;
+        uint32_t material;
 
         inline void face_normal(const Ray& r, const Vec3& outNormal)
         {
@@ -34,6 +36,21 @@ namespace Ilya
         }
     };
 
+    // Hit records are copied around at each hit of the innermost
+    // intersection loops: they should stay plain data.
+    static_assert(std::is_trivially_copyable_v<HitRecord>);
+
+    /// Point sampled on the surface of an object seen from another
+    /// point (see `Hittable::sample_light()`): the unit direction
+    /// towards it, its distance, and the probability density of that
+    /// direction, per unit of solid angle.
+    struct LightSample
+    {
+        Vec3 dir;
+        float distance;
+        float pdf;
+    };
+
     class Hittable
     {
         public:
@@ -44,6 +61,13 @@ namespace Ilya
             virtual bool hit(const Ray& r, float tmin, float tmax,
                              HitRecord& rec) const = 0;
 
+            /// Tells whether the ray `r` hits the object anywhere
+            /// between `tmin` and `tmax`. This is the query of shadow
+            /// rays, which only need a yes or no: any hit will do, so
+            /// objects can stop at the first one they find, and don't
+            /// fill a hit record. Defaults to `hit()`.
+            virtual bool occluded(const Ray& r, float tmin, float tmax) const;
+
             /// Creates a bounding box `box` around the object between
             /// times t0 and t1.
             virtual bool bounds(Bounds& box, float t0, float t1) const = 0;
@@ -57,10 +81,39 @@ namespace Ilya
 
             /// Returns the probability for the ray `r` to hit the
             /// object on a point of the surface.
-            virtual float pdf_value(const Ray& r)
+            virtual float pdf_value(const Ray& r) const
             {
                 return 0.f;
             }
+
+            /// Samples a point of the surface of the object seen from
+            /// `origin` at the time `time`, as `random_point()` does,
+            /// and puts its direction, distance and density in `sample`
+            /// in one go. Returns false if no point can be sampled. By
+            /// default, this calls `random_point()` and `pdf_value()`.
+            virtual bool sample_light(const Point3& origin, float time, LightSample& sample) const;
+
+            /// Power of the light emitted by the object (the luminance
+            /// of its material emission times its area, times pi for
+            /// a diffuse emitter), or 0 if it doesn't emit.
+            virtual float power() const
+            {
+                return 0.f;
+            }
+
+            /// Creates the bounds `light` of the light emitted by the
+            /// object (see `LightBounds`). By default, the light is
+            /// bounded by the bounding box of the object and emitted
+            /// in every direction.
+            virtual bool light_bounds(LightBounds& light) const
+            {
+                Bounds box {};
+                if(!bounds(box, 0.f, 1.f))
+                    return false;
+
+                light = {box, power()};
+                return true;
+            }
     };
 
     /// List of hittables, basically an improved vector of `Hittable`
@@ -82,18 +135,56 @@ namespace Ilya
             }
 
             bool hit(const Ray& r, float tmin, float tmax, HitRecord& rec) const override;
+            bool occluded(const Ray& r, float tmin, float tmax) const override;
             bool bounds(Bounds& box, float t0, float t1) const override;
 
             Point3 random_point(const Point3& origin) const override;
 
-            float pdf_value(const Ray& r) override;
+            float pdf_value(const Ray& r) const override;
+
+            float power() const override;
+            bool light_bounds(LightBounds& light) const override;
 
         public:
 
             std::vector<Ref<Hittable>> objects;
     };
 
-    /// Generates a BVH (Bounding Volume Hierarchy),
+    /// Primitive of a BVH under construction: its bounds, the center
+    /// of those bounds, and its index in the list of objects.
+    struct BVHprimitive
+    {
+        Bounds box;
+        Point3 centroid;
+        uint32_t index;
+    };
+
+    /// Split of a range of BVH primitives chosen by the SAH (see
+    /// `BVHnode::split()`): the box surrounding the range, and either
+    /// `leaf` if it should not be split, or the split axis and the
+    /// index of the first primitive on the right side.
+    struct BVHsplit
+    {
+        Bounds box;
+        bool leaf = false;
+        int axis = 0;
+        size_t mid = 0;
+    };
+
+    /// Report on the quality of a BVH: the time it took to build, its
+    /// number of nodes, leaves and primitives, its depth, and its
+    /// expected traversal cost as estimated by the surface area
+    /// heuristic (see `BVHnode`), in units of primitive intersections.
+    struct BVHstats
+    {
+        float build_ms;
+        uint32_t nodes, leaves, primitives, max_depth;
+        float sah_cost;
+    };
+
+    /// Generates a BVH (Bounding Volume Hierarchy), a tree of nested
+    /// bounding boxes over the objects of a list, built with the
+    /// surface area heuristic (SAH). Leaves hold a few objects each.
     class BVHnode: public Hittable
     {
         public:
@@ -107,12 +198,71 @@ namespace Ilya
                     size_t start, size_t end, float t0, float t1);
 
             bool hit(const Ray& r, float tmin, float tmax, HitRecord& rec) const override;
+            bool occluded(const Ray& r, float tmin, float tmax) const override;
             bool bounds(Bounds& box, float t0, float t1) const override;
 
+            /// Build time, size and SAH cost of the tree below this
+            /// node.
+            BVHstats stats() const;
+
+            /// Print `stats()`.
+            void report() const;
+
+        public:
+
+            /// Maximum number of objects in a leaf, number of bins
+            /// used to evaluate the split positions, and cost of
+            /// traversing a node relative to intersecting an object.
+            static constexpr uint32_t max_leaf_size = 4;
+            static constexpr uint32_t bins = 16;
+            static constexpr float traversal_cost = 0.5f;
+
+            /// Number of objects from which a node is built with
+            /// several threads.
+            static constexpr uint32_t parallel_build_size = 1 << 16;
+
+            /// Maximum depth of the tree: the BVHs that are walked with
+            /// an explicit stack (see `traverse()`) size it from this.
+            static constexpr uint32_t max_depth = 64;
+
+            /// Find the best SAH split of the primitives [start, end[ of
+            /// `prims`, for a node at `depth` in the tree, and partition
+            /// them in place around it, using up to `threads` threads
+            /// for large ranges. Ranges of at most `max_leaf` primitives
+            /// that are cheaper to intersect than to split are left
+            /// whole, and larger ones are always split, so that leaves
+            /// never hold more than `max_leaf` primitives; primitives
+            /// are costed as if intersected `width` at a time (see
+            /// `SphereSet`). This is the core of the builder, shared
+            /// with the BVHs that other objects keep over their own
+            /// primitives (see `TriangleMesh`).
+            static BVHsplit split(std::vector<BVHprimitive>& prims, size_t start,
+                                  size_t end, uint32_t threads, uint32_t depth = 0,
+                                  uint32_t max_leaf = max_leaf_size,
+                                  uint32_t width = 1);
+
         private:
 
-            Ref<Hittable> left, right;
+            BVHnode() = default;
+
+            /// Build the node at `depth` over the primitives [start,
+            /// end[ of `prims`, which are reordered in place, using up
+            /// to `threads` threads.
+            void build(const std::vector<Ref<Hittable>>& objects,
+                       std::vector<BVHprimitive>& prims, size_t start,
+                       size_t end, uint32_t threads, uint32_t depth);
+
+            /// Accumulate the statistics of the subtree at `depth`.
+            void gather(BVHstats& stats, uint32_t depth, float root_area) const;
+
+            Ref<BVHnode> left, right;
+            std::vector<Ref<Hittable>> leaf;
             Bounds box;
+            int axis = 0;
+            float build_ms = 0.f;
+
+            friend class LinearBVH;
+            template<int N> friend class WideBVH;
     };
 
     class Sphere: public Hittable
@@ -120,17 +270,25 @@ namespace Ilya
         public:
 
             Sphere(const Vec3& center, float radius, const Ref<Material>& mat):
-                    c0(center), c1(center), t0(0.f), t1(1.f), radius(radius), material(mat) {}
+                    c0(center), c1(center), t0(0.f), t1(1.f), radius(radius), material(MaterialTable::add(mat)) {}
 
             Sphere(const Vec3& c0, const Vec3& c1, float t0, float t1, float radius, const Ref<Material>& mat):
-                    c0(c0), c1(c1), t0(t0), t1(t1), radius(radius), material(mat) {}
+                    c0(c0), c1(c1), t0(t0), t1(t1), radius(radius), material(MaterialTable::add(mat)) {}
 
             bool hit(const Ray& r, float tmin, float tmax, HitRecord& rec) const override;
+            bool occluded(const Ray& r, float tmin, float tmax) const override;
             bool bounds(Bounds& box, float t0, float t1) const override;
 
             Point3 random_point(const Point3& origin) const override;
 
-            float pdf_value(const Ray& r) override;
+            /// Directions towards the sphere are sampled uniformly in
+            /// the cone under which it is seen, and their density is
+            /// found without intersecting the sphere; from inside the
+            /// sphere, points are sampled uniformly on its surface.
+            float pdf_value(const Ray& r) const override;
+            bool sample_light(const Point3& origin, float time, LightSample& sample) const override;
+
+            float power() const override;
 
             Point3 center(float t) const;
 
@@ -139,10 +297,9 @@ namespace Ilya
             float t0, t1;
             Point3 c0, c1;
             float radius;
-            Ref<Material> material;
-
-        private:
+            uint32_t material;
 
+            /// UV coordinates of the point `p` of the unit sphere.
             static std::pair<float, float> sphere_uv(const Vec3& p)
             {
                 // To get u and v on the sphere, we first need to get the
@@ -157,6 +314,12 @@ namespace Ilya
 
                 return { phi/(2*pi), theta/pi };
             }
+
+        private:
+
+            /// Distance `t` of the nearest intersection of the ray `r`
+            /// with the sphere between `tmin` and `tmax`, if any.
+            bool nearest_root(const Ray& r, float tmin, float tmax, float& t) const;
     };
 
     template<Axis ax0, Axis ax1> requires (ax0 < ax1)
@@ -166,17 +329,24 @@ namespace Ilya
 
             Rectangle(float r0, float s0, float r1, float s1, float k,
                       const Ref<Material>& mat):
-                      r0(r0), s0(s0), r1(r1), s1(s1), k(k), material(mat) {}
+                      r0(r0), s0(s0), r1(r1), s1(s1), k(k), material(MaterialTable::add(mat)) {}
 
             bool hit(const Ray& r, float tmin, float tmax, HitRecord& rec) const override;
+            bool occluded(const Ray& r, float tmin, float tmax) const override;
             bool bounds(Bounds& box, float t0, float t1) const override;
             Point3 random_point(const Point3& origin) const override;
-            float pdf_value(const Ray& r) override;
+            float pdf_value(const Ray& r) const override;
+            bool sample_light(const Point3& origin, float time, LightSample& sample) const override;
+            float power() const override;
+
+            /// A rectangle emits from its front face, on the positive
+            /// side of its normal axis.
+            bool light_bounds(LightBounds& light) const override;
 
         public:
 
             float r0, s0, r1, s1, k;
-            Ref<Material> material;
+            uint32_t material;
     };
 
     class Box: public Hittable
@@ -187,6 +357,11 @@ namespace Ilya
 
             bool hit(const Ray& r, float tmin, float tmax, HitRecord& rec) const override;
 
+            bool occluded(const Ray& r, float tmin, float tmax) const override
+            {
+                return sides.occluded(r, tmin, tmax);
+            }
+
             bool bounds(Bounds& box, float t0, float t1) const override
             {
                 box = {p0, p1};
@@ -194,6 +369,16 @@ namespace Ilya
                 return true;
             }
 
+            float power() const override
+            {
+                return sides.power();
+            }
+
+            bool light_bounds(LightBounds& light) const override
+            {
+                return sides.light_bounds(light);
+            }
+
         public:
 
             Point3 p0, p1;
@@ -206,7 +391,7 @@ namespace Ilya
 
             ConstantMedium(const Ref<Hittable>& boundary,
                            const Ref<Texture>& tex, float density):
-                           boundary(boundary), phase_func(std::make_shared<Isotropic>(tex)), density(density) {}
+                           boundary(boundary), phase_func(MaterialTable::add(std::make_shared<Isotropic>(tex))), density(density) {}
 
             ConstantMedium(const Ref<Hittable>& boundary, const Color& c, float density):
                     ConstantMedium(boundary, std::make_shared<SolidColor>(c), density) {}
@@ -222,6 +407,6 @@ namespace Ilya
 
             float density;
             Ref<Hittable> boundary;
-            Ref<Material> phase_func;
+            uint32_t phase_func;
     };
 }
\ No newline at end of file
@@ -49,7 +49,7 @@ namespace Ilya
     {
         hadbox = obj->bounds(box, 0.f, 1.f);
 
-        auto theta = radians(angle);
+        theta = radians(angle);
         sin = std::sin(theta);
         cos = std::cos(theta);
 
@@ -106,25 +106,8 @@ namespace Ilya
     }
 
     template<Axis axis>
-    bool Rotate<axis>::hit(const Ray& r, float tmin, float tmax, HitRecord& rec) const
+    Ray Rotate<axis>::rotated(const Ray& r) const
     {
-        int ax1, ax2;
-        if constexpr(axis == Axis::X)
-        {
-            ax1 = (int)Axis::Y;
-            ax2 = (int)Axis::Z;
-        }
-        else if constexpr(axis == Axis::Y)
-        {
-            ax1 = (int)Axis::X;
-            ax2 = (int)Axis::Z;
-        }
-        else if constexpr(axis == Axis::Z)
-        {
-            ax1 = (int)Axis::X;
-            ax2 = (int)Axis::Y;
-        }
-
         auto orig = r.orig;
         auto dir = r.dir;
         
@@ -134,7 +117,13 @@ namespace Ilya
         dir[ax1] = cos*r.dir[ax1] - sin*r.dir[ax2];
         dir[ax2] = sin*r.dir[ax1] + cos*r.dir[ax2];
 
-        Ray rp {orig, dir, r.cast_time};
+        return {orig, dir, r.cast_time};
+    }
+
+    template<Axis axis>
+    bool Rotate<axis>::hit(const Ray& r, float tmin, float tmax, HitRecord& rec) const
+    {
+        auto rp = rotated(r);
 
         if(!obj->hit(rp, tmin, tmax, rec))
             return false;
@@ -154,10 +143,225 @@ namespace Ilya
         return true;
     }
 
+    template<Axis axis>
+    bool Rotate<axis>::occluded(const Ray& r, float tmin, float tmax) const
+    {
+        return obj->occluded(rotated(r), tmin, tmax);
+    }
+
+    template<Axis axis>
+    Transform Rotate<axis>::transform() const
+    {
+        // The ray is rotated by the angle in `hit()`, so the object is
+        // rotated by its opposite; because of the orientation of the
+        // coordinate system, this is the positive angle for the Y axis
+        // and the negative one for the others.
+        return Ilya::rotate<axis>(axis == Axis::Y ? theta : -theta);
+    }
+
     template class Rotate<Axis::X>;
     template class Rotate<Axis::Y>;
     template class Rotate<Axis::Z>;
 
+    /// The affine transform `m` applied to the point `p`, and to the
+    /// vector `v` (which the translation doesn't move).
+    static Point3 apply_point(const Mat4x3& m, const Point3& p)
+    {
+        return Point3{m[0]*p.x + m[1]*p.y + m[2]*p.z + m[3]};
+    }
+
+    static Vec3 apply_vector(const Mat4x3& m, const Vec3& v)
+    {
+        return m[0]*v.x + m[1]*v.y + m[2]*v.z;
+    }
+
+    Instance::Instance(const Ref<Hittable>& obj, const Transform& transform, bool flipped):
+        obj(obj), to_world(transform.transform), to_object(transform.inv),
+        normal_matrix(transform.normal_matrix), flipped(flipped)
+    {
+        // Normals are transformed by the inverse transpose of the
+        // object-to-scene matrix (see `Transform::operator()(const
+        // Normal&)`); for rotations and translations, that is the
+        // rotation itself, which keeps the normals normalized.
+        rigid = true;
+        for (int i = 0; i < 3; ++i)
+            rigid &= length(normal_matrix[i] - Vec3{to_world[i]}) < 1e-5f;
+
+        det = std::abs(dot(to_world[0], cross(to_world[1], to_world[2])));
+
+        Bounds objbox {};
+        hadbox = obj->bounds(objbox, 0.f, 1.f);
+        if(hadbox)
+            box = transform(objbox);
+    }
+
+    bool Instance::hit(const Ray& r, float tmin, float tmax, HitRecord& rec) const
+    {
+        // The ray is moved to the space of the object, where its
+        // direction is not normalized again: the distances along it
+        // stay the same on both sides, so the range and the distance
+        // of the hit don't change.
+        Ray local {apply_point(to_object, r.orig), apply_vector(to_object, r.dir), r.cast_time};
+        if(!obj->hit(local, tmin, tmax, rec))
+            return false;
+
+        // The normal was made to face the ray in object space, and
+        // still does once transformed, since the angle between them
+        // keeps its sign.
+        rec.p = apply_point(to_world, rec.p);
+        rec.normal = normal_matrix*rec.normal;
+        if(!rigid)
+            rec.normal = normalize(rec.normal);
+        if(flipped)
+            rec.frontFace = !rec.frontFace;
+
+        return true;
+    }
+
+    bool Instance::occluded(const Ray& r, float tmin, float tmax) const
+    {
+        // Only the ray is transformed: there is no hit to bring back.
+        return obj->occluded({apply_point(to_object, r.orig), apply_vector(to_object, r.dir), r.cast_time},
+                             tmin, tmax);
+    }
+
+    Point3 Instance::random_point(const Point3& origin) const
+    {
+        auto v = obj->random_point(apply_point(to_object, origin));
+
+        return Point3{apply_vector(to_world, Vec3{v.x, v.y, v.z})};
+    }
+
+    float Instance::pdf_value(const Ray& r) const
+    {
+        auto pdf = obj->pdf_value(Ray{apply_point(to_object, r.orig), apply_vector(to_object, r.dir), r.cast_time});
+        if(rigid || pdf == 0.f)
+            return pdf;
+
+        // The linear part A of the transform maps the unit direction w
+        // of the object to A*w/|A*w|, which stretches solid angles by
+        // |det A|/|A*w|^3: the density is divided by that. For the unit
+        // direction d of the ray, w is A^-1*d up to its length, and
+        // |A*w| = 1/|A^-1*d|.
+        auto w = length(apply_vector(to_object, normalize(r.dir)));
+        return pdf/(det*w*w*w);
+    }
+
+    bool Instance::sample_light(const Point3& origin, float time, LightSample& sample) const
+    {
+        if(!obj->sample_light(apply_point(to_object, origin), time, sample))
+            return false;
+
+        auto v = apply_vector(to_world, sample.dir*sample.distance);
+        auto distance = length(v);
+
+        // Same change of density as in `pdf_value()`, with |A*w| the
+        // ratio of the distances on both sides.
+        if(!rigid)
+        {
+            auto w = distance/sample.distance;
+            sample.pdf *= w*w*w/det;
+        }
+
+        sample.distance = distance;
+        sample.dir = v/distance;
+
+        return true;
+    }
+
+    float Instance::power() const
+    {
+        if(rigid)
+            return obj->power();
+
+        return obj->power() * std::pow(det, 2.f/3.f);
+    }
+
+    bool Instance::light_bounds(LightBounds& light) const
+    {
+        if(!obj->light_bounds(light))
+            return false;
+
+        Bounds box {apply_point(to_world, light.box.min)};
+        for (int corner = 1; corner < 8; ++corner)
+        {
+            Point3 p {light.box[corner & 1].x, light.box[(corner >> 1) & 1].y, light.box[corner >> 2].z};
+            box = surrounding_box(box, apply_point(to_world, p));
+        }
+
+        light.box = box;
+        light.phi = power();
+        light.w = normalize(rigid ? apply_vector(to_world, light.w) : normal_matrix*light.w);
+        if(flipped)
+            light.w = -light.w;
+
+        return true;
+    }
+
+    Ref<Instance> instance(const Ref<Hittable>& obj, const Transform& transform, bool flipped)
+    {
+        return std::make_shared<Instance>(obj, transform, flipped);
+    }
+
+    Ref<Hittable> collapse_instances(const Ref<Hittable>& obj)
+    {
+        // Go down the chain of wrappers from the outermost one, which
+        // is the last transform applied to the object: each one is
+        // thus multiplied on the right of the ones above it.
+        Transform transform {Mat4{1.f}, Mat4{1.f}};
+        bool transformed = false, flipped = false;
+
+        auto current = obj;
+        while(true)
+        {
+            if(auto t = dynamic_cast<const Translate*>(current.get()))
+            {
+                transform = transform*t->transform();
+                transformed = true;
+                current = t->object();
+            }
+            else if(auto r = dynamic_cast<const Rotate<Axis::X>*>(current.get()))
+            {
+                transform = transform*r->transform();
+                transformed = true;
+                current = r->object();
+            }
+            else if(auto r = dynamic_cast<const Rotate<Axis::Y>*>(current.get()))
+            {
+                transform = transform*r->transform();
+                transformed = true;
+                current = r->object();
+            }
+            else if(auto r = dynamic_cast<const Rotate<Axis::Z>*>(current.get()))
+            {
+                transform = transform*r->transform();
+                transformed = true;
+                current = r->object();
+            }
+            else if(auto f = dynamic_cast<const Flip*>(current.get()))
+            {
+                flipped = !flipped;
+                current = f->object();
+            }
+            else
+                break;
+        }
+
+        if(auto list = dynamic_cast<HittableList*>(current.get()))
+            collapse_instances(*list);
+
+        if(!transformed)
+            return obj;
+
+        return instance(current, transform, flipped);
+    }
+
+    void collapse_instances(HittableList& list)
+    {
+        for (auto& obj: list.objects)
+            obj = collapse_instances(obj);
+    }
+
     Ref<Translate> translate(const Ref<Hittable>& obj, const Vec3& offset)
     {
         return std::make_shared<Translate>(obj, offset);
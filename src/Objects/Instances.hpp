@@ -19,8 +19,20 @@ namespace Ilya
                 obj(obj), offset(offset) {}
 
             bool hit(const Ray& r, float tmin, float tmax, HitRecord& rec) const override;
+
+            bool occluded(const Ray& r, float tmin, float tmax) const override
+            {
+                return obj->occluded({r.orig - offset, r.dir, r.cast_time}, tmin, tmax);
+            }
+
             bool bounds(Bounds& box, float t0, float t1) const override;
 
+            const Ref<Hittable>& object() const { return obj; }
+
+            /// The translation as a transform from the object to the
+            /// scene.
+            Transform transform() const { return Ilya::translate(offset); }
+
         private:
 
             Vec3 offset;
@@ -37,6 +49,7 @@ namespace Ilya
             Rotate(const Ref<Hittable>& obj, float angle);
 
             bool hit(const Ray& r, float tmin, float tmax, HitRecord& rec) const override;
+            bool occluded(const Ray& r, float tmin, float tmax) const override;
 
             bool bounds(Bounds& box, float t0, float t1) const override
             {
@@ -45,12 +58,25 @@ namespace Ilya
                 return hadbox;
             }
 
+            const Ref<Hittable>& object() const { return obj; }
+
+            /// The rotation as a transform from the object to the
+            /// scene.
+            Transform transform() const;
+
         private:
 
+            /// The ray `r` rotated to the space of the object.
+            Ray rotated(const Ray& r) const;
+
+            /// The two axes of the plane of the rotation.
+            static constexpr int ax1 = axis == Axis::X ? int(Axis::Y) : int(Axis::X);
+            static constexpr int ax2 = axis == Axis::Z ? int(Axis::Y) : int(Axis::Z);
+
             Ref<Hittable> obj;
             Bounds box {};
             bool hadbox;
-            float sin, cos;
+            float theta, sin, cos;
     };
 
     /// Instancing class for flipping the object's normals (see the
@@ -71,6 +97,11 @@ namespace Ilya
                 return true;
             }
 
+            bool occluded(const Ray& r, float tmin, float tmax) const override
+            {
+                return obj->occluded(r, tmin, tmax);
+            }
+
             bool bounds(Bounds& box, float t0, float t1) const override
             {
                 return obj->bounds(box, t0, t1);
@@ -81,16 +112,118 @@ namespace Ilya
                 return obj->random_point(origin);
             }
 
-            float pdf_value(const Ray& r) override
+            float pdf_value(const Ray& r) const override
             {
                 return obj->pdf_value(r);
             }
 
+            bool sample_light(const Point3& origin, float time, LightSample& sample) const override
+            {
+                return obj->sample_light(origin, time, sample);
+            }
+
+            /// Flipping the faces only changes the side the light is
+            /// emitted from, not its power.
+            float power() const override
+            {
+                return obj->power();
+            }
+
+            bool light_bounds(LightBounds& light) const override
+            {
+                if(!obj->light_bounds(light))
+                    return false;
+
+                light.w = -light.w;
+                return true;
+            }
+
+            const Ref<Hittable>& object() const { return obj; }
+
         private:
 
             Ref<Hittable> obj;
     };
 
+    /// @brief Object placed in the scene by an affine transform
+    ///
+    /// Where `Translate` and `Rotate` each wrap an object and move the
+    /// ray by one step, an instance moves it with a single affine
+    /// transform from the scene to the object, stored as a 3x4 matrix
+    /// along with its inverse and the matrix of the normals, so that a
+    /// hit costs one matrix multiply on the way in and one on the way
+    /// out. The object is shared: it is the bottom level of a two-level
+    /// hierarchy, typically a `TriangleMesh` or a BVH over a list, and
+    /// a thousand instances of it cost a thousand transforms rather
+    /// than a thousand copies of its geometry. A BVH over the instances
+    /// is the top level, which finds the ones a ray may hit.
+    class Instance: public Hittable
+    {
+        public:
+
+            /// Place `obj` with the object-to-scene transform `transform`,
+            /// flipping its faces if `flipped` (see `Flip`).
+            Instance(const Ref<Hittable>& obj, const Transform& transform, bool flipped = false);
+
+            bool hit(const Ray& r, float tmin, float tmax, HitRecord& rec) const override;
+            bool occluded(const Ray& r, float tmin, float tmax) const override;
+
+            bool bounds(Bounds& box, float t0, float t1) const override
+            {
+                box = this->box;
+
+                return hadbox;
+            }
+
+            /// The object is sampled from the other side of the
+            /// transform. Rigid transforms (rotations and translations)
+            /// keep the solid angles, and then the densities; others
+            /// stretch them, which the densities account for (see
+            /// `pdf_value()`).
+            Point3 random_point(const Point3& origin) const override;
+            float pdf_value(const Ray& r) const override;
+            bool sample_light(const Point3& origin, float time, LightSample& sample) const override;
+
+            /// Scaling changes the area of the object, and then its
+            /// power, by a factor that depends on the orientation of
+            /// each surface; the factor of a uniform scaling (the
+            /// determinant to the power 2/3) is used for all of them.
+            float power() const override;
+
+            /// Only the axis of the cone of emitted directions is
+            /// transformed, like a normal: cones that are not reduced
+            /// to a single direction are only approximated when the
+            /// transform scales them unevenly.
+            bool light_bounds(LightBounds& light) const override;
+
+        public:
+
+            Ref<Hittable> obj;
+
+        private:
+
+            Mat4x3 to_world, to_object;
+            Mat3 normal_matrix;
+            float det;  // |det| of the linear part of `to_world`
+            Bounds box {};
+            bool hadbox;
+            bool flipped, rigid;
+    };
+
+    Ref<Instance> instance(const Ref<Hittable>& obj, const Transform& transform, bool flipped = false);
+
+    /// @brief Fold chains of instancing wrappers into single instances
+    ///
+    /// Scene compile pass: each chain of `Translate`, `Rotate` and
+    /// `Flip` wrappers around an object (for instance a box rotated,
+    /// then translated) is replaced by one `Instance` of the object
+    /// with the product of their transforms, so that a hit goes
+    /// through one transform instead of one virtual call and one
+    /// transform per wrapper. Chains of `Flip` alone are left as they
+    /// are, since they don't transform anything. Lists are compiled
+    /// recursively, in place.
+    Ref<Hittable> collapse_instances(const Ref<Hittable>& obj);
+    void collapse_instances(HittableList& list);
     Ref<Translate> translate(const Ref<Hittable>& obj, const Vec3& offset);
     template<Axis N> Ref<Rotate<N>> rotate(const Ref<Hittable>& obj, float angle);
     Ref<Flip> flip(const Ref <Hittable>& obj);
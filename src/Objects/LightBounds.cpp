@@ -0,0 +1,123 @@
+
+#include "LightBounds.hpp"
+
+#include "Utils/Math/functions.hpp"
+
+namespace Ilya
+{
+    static float safe_sqrt(float x)
+    {
+        return std::sqrt(std::max(x, 0.f));
+    }
+
+    // Cosine and sine of the angle a - b, clamped to 0 when b > a,
+    // from the cosines and sines of a and b.
+    static float cos_sub_clamped(float sin_a, float cos_a, float sin_b, float cos_b)
+    {
+        return cos_a > cos_b ? 1.f : cos_a*cos_b + sin_a*sin_b;
+    }
+
+    static float sin_sub_clamped(float sin_a, float cos_a, float sin_b, float cos_b)
+    {
+        return cos_a > cos_b ? 0.f : sin_a*cos_b - cos_a*sin_b;
+    }
+
+    float LightBounds::importance(const Point3& p, const Vec3& n) const
+    {
+        // The light received at p from an emitter of power phi falls
+        // off with the squared distance d^2, and with the cosine of
+        // the angle between the emitting direction and the normal of
+        // the surface that emits. Over the whole box, both are bounded
+        // from the box center: the distance is clamped to the radius
+        // of the sphere around the box, so that points inside it are
+        // not favoured endlessly, and the smallest angle between the
+        // cone of normals and the direction towards p is the angle
+        // theta_w between `w` and p, minus theta_o (the spread of the
+        // normals), minus theta_b, the angle under which the box
+        // itself is seen from p. If that angle is past theta_e, no
+        // point of the box emits towards p.
+        auto pc = box.centroid();
+        auto to_p = p - pc;
+        auto d2 = square(to_p);
+        auto r2 = square(box.max - box.min)/4;
+
+        auto wi = d2 > 0.f ? to_p/std::sqrt(d2) : w;
+        auto cos_theta_w = dot(w, wi);
+        if(two_sided)
+            cos_theta_w = std::abs(cos_theta_w);
+        auto sin_theta_w = safe_sqrt(1.f - cos_theta_w*cos_theta_w);
+
+        auto cos_theta_b = d2 < r2 ? -1.f : safe_sqrt(1.f - r2/d2);
+        auto sin_theta_b = safe_sqrt(1.f - cos_theta_b*cos_theta_b);
+
+        auto sin_theta_o = safe_sqrt(1.f - cos_theta_o*cos_theta_o);
+        auto cos_theta_x = cos_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, cos_theta_o);
+        auto sin_theta_x = sin_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, cos_theta_o);
+        auto cos_theta_p = cos_sub_clamped(sin_theta_x, cos_theta_x, sin_theta_b, cos_theta_b);
+        if(cos_theta_p <= cos_theta_e)
+            return 0.f;
+
+        auto importance = phi*cos_theta_p/std::max(d2, r2);
+
+        // At a surface, the light is also attenuated by the cosine of
+        // the angle theta_i with the normal, bounded in the same way
+        // (on both sides of the surface, which may transmit light).
+        if(n != Vec3{0.f})
+        {
+            auto cos_theta_i = std::abs(dot(wi, n));
+            auto sin_theta_i = safe_sqrt(1.f - cos_theta_i*cos_theta_i);
+            importance *= cos_sub_clamped(sin_theta_i, cos_theta_i, sin_theta_b, cos_theta_b);
+        }
+
+        return std::max(importance, 0.f);
+    }
+
+    LightBounds surrounding_light(const LightBounds& a, const LightBounds& b)
+    {
+        if(a.phi == 0.f)
+            return b;
+        if(b.phi == 0.f)
+            return a;
+
+        LightBounds bounds {surrounding_box(a.box, b.box), a.phi + b.phi};
+        bounds.cos_theta_e = std::min(a.cos_theta_e, b.cos_theta_e);
+        bounds.two_sided = a.two_sided || b.two_sided;
+
+        // The cone of normals around both cones: if one of them
+        // contains the other, it is the result; otherwise the result
+        // spans from the far side of one cone to the far side of the
+        // other, and its axis is the axis of the first cone rotated
+        // towards the second one until it is in the middle.
+        auto theta_a = std::acos(std::clamp(a.cos_theta_o, -1.f, 1.f));
+        auto theta_b = std::acos(std::clamp(b.cos_theta_o, -1.f, 1.f));
+        auto theta_d = std::acos(std::clamp(dot(a.w, b.w), -1.f, 1.f));
+
+        if(std::min(theta_d + theta_b, pi) <= theta_a)
+        {
+            bounds.w = a.w;
+            bounds.cos_theta_o = a.cos_theta_o;
+            return bounds;
+        }
+
+        if(std::min(theta_d + theta_a, pi) <= theta_b)
+        {
+            bounds.w = b.w;
+            bounds.cos_theta_o = b.cos_theta_o;
+            return bounds;
+        }
+
+        auto theta_o = (theta_a + theta_d + theta_b)/2;
+        auto axis = cross(a.w, b.w);
+        if(theta_o >= pi || square(axis) == 0.f)
+            return bounds;
+
+        // Rodrigues' rotation of a.w by theta_r around the axis, which
+        // is perpendicular to a.w.
+        auto theta_r = theta_o - theta_a;
+        axis = normalize(axis);
+        bounds.w = a.w*std::cos(theta_r) + cross(axis, a.w)*std::sin(theta_r);
+        bounds.cos_theta_o = std::cos(theta_o);
+
+        return bounds;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,38 @@
+
+#pragma once
+
+#include "Bounds.hpp"
+
+namespace Ilya
+{
+    /// @brief Bounds of the light emitted by an object
+    ///
+    /// Where `Bounds` tell where an object is, light bounds also tell
+    /// how much light it emits and towards where, so that the light
+    /// reaching a point from a whole group of lights can be bounded
+    /// without looking at each of them (see `LightSampler`). The
+    /// object emits a power `phi` from the box `box`; the normals of
+    /// its emitting surfaces lie within the angle theta_o of the
+    /// direction `w`, and each point of the surfaces emits up to the
+    /// angle theta_e of its normal (pi/2 for a diffuse emitter), on
+    /// both sides of the surface if the light is `two_sided`. The
+    /// angles are stored as cosines; the defaults emit everywhere.
+    struct LightBounds
+    {
+        Bounds box;
+        float phi = 0.f;
+        Vec3 w {0.f, 0.f, 1.f};
+        float cos_theta_o = -1.f;
+        float cos_theta_e = 0.f;
+        bool two_sided = false;
+
+        /// Upper bound of the light that the point `p` of a surface
+        /// of normal `n` receives from the lights in the bounds, up to
+        /// a constant factor; `n` is zero for points in a medium,
+        /// which receive light from every direction.
+        float importance(const Point3& p, const Vec3& n) const;
+    };
+
+    /// Light bounds of the lights of both `a` and `b`.
+    LightBounds surrounding_light(const LightBounds& a, const LightBounds& b);
+}
\ No newline at end of file
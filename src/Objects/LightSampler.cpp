@@ -0,0 +1,404 @@
+
+#include "LightSampler.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <numeric>
+
+namespace Ilya
+{
+    LightSampler::LightSampler(const std::vector<Ref<Hittable>>& lights, bool tree):
+        lights(lights), tree(tree)
+    {
+        if(lights.empty())
+            return;
+
+        auto n = static_cast<uint32_t>(lights.size());
+
+        std::vector<float> weights(n);
+        auto total = 0.f;
+
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            weights[i] = std::max(lights[i]->power(), 0.f);
+            total += weights[i];
+        }
+
+        if(total == 0.f)
+            std::fill(weights.begin(), weights.end(), 1.f);
+
+        if(!tree)
+            build_alias(weights);
+
+        std::vector<Light> prims;
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            if(weights[i] == 0.f)
+                continue;
+
+            LightBounds bounds {};
+            if(!lights[i]->light_bounds(bounds))
+            {
+                unbounded.push_back(i);
+                continue;
+            }
+
+            bounds.phi = weights[i];
+            prims.push_back({i, bounds});
+        }
+
+        trails.assign(n, no_trail);
+        if(!prims.empty())
+            build(prims, 0, prims.size(), 0, 0);
+    }
+
+    void LightSampler::build_alias(const std::vector<float>& weights)
+    {
+        auto n = static_cast<uint32_t>(weights.size());
+        auto total = std::accumulate(weights.begin(), weights.end(), 0.f);
+
+        bins.resize(n);
+        pmfs.resize(n);
+
+        // Build the table with Vose's method: the probabilities are
+        // scaled so that they average to 1, and each bin is filled by
+        // taking a light below 1 (which fills part of its bin) and a
+        // light above 1, which takes the rest of that bin as its alias
+        // and gives up that part of its own probability. The light
+        // above 1 then goes back in the list it now belongs to, until
+        // every bin is full.
+        std::vector<float> scaled(n);
+        std::vector<uint32_t> small, large;
+
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            pmfs[i] = weights[i]/total;
+            scaled[i] = pmfs[i]*n;
+            (scaled[i] < 1.f ? small : large).push_back(i);
+        }
+
+        while(!small.empty() && !large.empty())
+        {
+            auto s = small.back();
+            auto l = large.back();
+            small.pop_back();
+            large.pop_back();
+
+            bins[s] = {scaled[s], l};
+            scaled[l] = (scaled[l] + scaled[s]) - 1.f;
+            (scaled[l] < 1.f ? small : large).push_back(l);
+        }
+
+        // What is left is full up to rounding errors.
+        for (auto i: small)
+            bins[i] = {1.f, i};
+        for (auto i: large)
+            bins[i] = {1.f, i};
+    }
+
+    /// Cost of a node with the light bounds `b` in a node whose box is
+    /// `box`, split along `axis`: the surface area heuristic of the
+    /// BVHs (see `BVHnode`), weighted by the power of the node and by
+    /// the solid angle of its cone of emitted directions (a node whose
+    /// lights shine everywhere is picked from more points), and with
+    /// a penalty for thin splits across long boxes.
+    static float split_cost(const LightBounds& b, const Bounds& box, int axis)
+    {
+        auto theta_o = std::acos(std::clamp(b.cos_theta_o, -1.f, 1.f));
+        auto theta_e = std::acos(std::clamp(b.cos_theta_e, -1.f, 1.f));
+        auto theta_w = std::min(theta_o + theta_e, pi);
+        auto sin_theta_o = std::sqrt(std::max(1.f - b.cos_theta_o*b.cos_theta_o, 0.f));
+
+        auto solid_angle = 2*pi*(1 - b.cos_theta_o) +
+                pi/2*(2*theta_w*sin_theta_o - std::cos(theta_o - 2*theta_w) -
+                      2*theta_o*sin_theta_o + b.cos_theta_o);
+
+        auto d = box.max - box.min;
+        auto kr = d[axis] > 0.f ? std::max({d.x, d.y, d.z})/d[axis] : 1.f;
+
+        return b.phi*solid_angle*kr*b.box.area();
+    }
+
+    uint32_t LightSampler::build(std::vector<Light>& prims, size_t start, size_t end,
+                                 uint64_t trail, uint32_t depth)
+    {
+        auto node = static_cast<uint32_t>(nodes.size());
+
+        if(end - start == 1)
+        {
+            nodes.push_back({prims[start].bounds, prims[start].index, true});
+            trails[prims[start].index] = trail;
+
+            return node;
+        }
+
+        // The trail has one bit per level, so the depth of the tree is
+        // bounded as in `BVHnode::split()`: once halving the lights
+        // until they are alone would take it past `max_depth`, they
+        // are split at their median instead of by cost.
+        bool median = depth + std::bit_width(end - start - 1) >= max_depth;
+
+        // As in `BVHnode::split()`, the lights are binned by their
+        // centroid along each axis, and the split between two buckets
+        // of lowest cost is chosen.
+        auto box = prims[start].bounds.box;
+        Bounds centroids {prims[start].bounds.box.centroid()};
+        for (auto i = start + 1; i < end; ++i)
+        {
+            box = surrounding_box(box, prims[i].bounds.box);
+            centroids = surrounding_box(centroids, prims[i].bounds.box.centroid());
+        }
+
+        auto bucket = [&](const Light& light, int axis)
+        {
+            auto b = static_cast<uint32_t>(buckets*centroids.offset(light.bounds.box.centroid())[axis]);
+            return std::min(b, buckets - 1);
+        };
+
+        auto min_cost = infinity;
+        int split_axis = -1;
+        uint32_t split_bucket = 0;
+
+        for (int axis = 0; !median && axis < 3; ++axis)
+        {
+            if(centroids.max[axis] == centroids.min[axis])
+                continue;
+
+            LightBounds bucket_bounds[buckets] {};
+            for (auto i = start; i < end; ++i)
+            {
+                auto& b = bucket_bounds[bucket(prims[i], axis)];
+                b = surrounding_light(b, prims[i].bounds);
+            }
+
+            // Cost of splitting after each bucket, from the bounds of
+            // the buckets on each side.
+            LightBounds below {};
+            float costs[buckets - 1];
+            for (uint32_t b = 0; b < buckets - 1; ++b)
+            {
+                below = surrounding_light(below, bucket_bounds[b]);
+                costs[b] = split_cost(below, box, axis);
+            }
+
+            LightBounds above {};
+            for (auto b = buckets - 1; b > 0; --b)
+            {
+                above = surrounding_light(above, bucket_bounds[b]);
+                costs[b - 1] += split_cost(above, box, axis);
+            }
+
+            for (uint32_t b = 0; b < buckets - 1; ++b)
+            {
+                if(costs[b] > 0.f && costs[b] < min_cost)
+                {
+                    min_cost = costs[b];
+                    split_axis = axis;
+                    split_bucket = b;
+                }
+            }
+        }
+
+        auto mid = start + (end - start)/2;
+        if(median)
+        {
+            auto axis = centroids.max_extent();
+            std::nth_element(prims.begin() + start, prims.begin() + mid, prims.begin() + end,
+                             [axis](const Light& a, const Light& b)
+                             {
+                                 return a.bounds.box.centroid()[axis] < b.bounds.box.centroid()[axis];
+                             });
+        }
+        else if(split_axis >= 0)
+        {
+            auto it = std::partition(prims.begin() + start, prims.begin() + end,
+                                     [&](const Light& light) { return bucket(light, split_axis) <= split_bucket; });
+            auto split = static_cast<size_t>(it - prims.begin());
+
+            if(split != start && split != end)
+                mid = split;
+        }
+
+        nodes.push_back({});
+        auto first = build(prims, start, mid, trail, depth + 1);
+        auto second = build(prims, mid, end, trail | (1ull << depth), depth + 1);
+        nodes[node] = {surrounding_light(nodes[first].bounds, nodes[second].bounds), second, false};
+
+        return node;
+    }
+
+    float LightSampler::unbounded_pmf() const
+    {
+        if(unbounded.empty())
+            return 0.f;
+
+        auto count = static_cast<float>(unbounded.size());
+        return count/(count + (nodes.empty() ? 0.f : 1.f));
+    }
+
+    bool LightSampler::sample(const Point3& p, const Vec3& n, float u,
+                              uint32_t& index, float& pmf) const
+    {
+        if(lights.empty())
+            return false;
+
+        if(!tree)
+        {
+            // The integer part of u*n picks the bin, and its fractional
+            // part, which is still uniform in [0, 1[, one of the two
+            // lights of the bin.
+            auto scaled = u*static_cast<float>(bins.size());
+            auto bin = std::min(static_cast<uint32_t>(scaled), size() - 1);
+
+            index = scaled - bin < bins[bin].keep ? bin : bins[bin].alias;
+            pmf = pmfs[index];
+            return true;
+        }
+
+        // The lights without bounds take the bottom of the range of u,
+        // one equal share each; the rest of it is rescaled to [0, 1[
+        // for the tree.
+        auto p_unbounded = unbounded_pmf();
+        if(u < p_unbounded)
+        {
+            auto count = static_cast<uint32_t>(unbounded.size());
+            index = unbounded[std::min(static_cast<uint32_t>(u/p_unbounded*count), count - 1)];
+            pmf = p_unbounded/count;
+            return true;
+        }
+
+        if(nodes.empty())
+            return false;
+
+        u = std::min((u - p_unbounded)/(1.f - p_unbounded), 1.f - 0x1p-24f);
+
+        // Go down the tree, picking a child at each node according to
+        // the importance of both; u is rescaled to [0, 1[ within the
+        // range of the child it picked, so that the same number serves
+        // at every level.
+        uint32_t node = 0;
+        pmf = 1.f - p_unbounded;
+
+        while(!nodes[node].leaf)
+        {
+            auto second = nodes[node].index;
+            auto i0 = nodes[node + 1].bounds.importance(p, n);
+            auto i1 = nodes[second].bounds.importance(p, n);
+            if(i0 == 0.f && i1 == 0.f)
+                return false;
+
+            auto p0 = i0/(i0 + i1);
+            if(u < p0)
+            {
+                u = std::min(u/p0, 1.f - 0x1p-24f);
+                pmf *= p0;
+                node = node + 1;
+            }
+            else
+            {
+                u = std::min((u - p0)/(1.f - p0), 1.f - 0x1p-24f);
+                pmf *= 1.f - p0;
+                node = second;
+            }
+        }
+
+        // A single light is the root: check it can reach the point.
+        if(node == 0 && nodes[0].bounds.importance(p, n) == 0.f)
+            return false;
+
+        index = nodes[node].index;
+        return true;
+    }
+
+    float LightSampler::pmf(const Point3& p, const Vec3& n, uint32_t index) const
+    {
+        if(!tree)
+            return pmfs[index];
+
+        // Lights out of the tree are either unbounded, with their
+        // fixed share, or never picked. There are few unbounded lights,
+        // if any.
+        auto trail = trails[index];
+        if(trail == no_trail)
+        {
+            if(std::find(unbounded.begin(), unbounded.end(), index) == unbounded.end())
+                return 0.f;
+
+            return unbounded_pmf()/static_cast<float>(unbounded.size());
+        }
+
+        // Follow the trail of the light down the tree, with the same
+        // probabilities as `sample()`.
+        uint32_t node = 0;
+        auto pmf = 1.f - unbounded_pmf();
+
+        while(!nodes[node].leaf)
+        {
+            auto second = nodes[node].index;
+            auto i0 = nodes[node + 1].bounds.importance(p, n);
+            auto i1 = nodes[second].bounds.importance(p, n);
+            if(i0 == 0.f && i1 == 0.f)
+                return 0.f;
+
+            pmf *= ((trail & 1) ? i1 : i0)/(i0 + i1);
+            node = (trail & 1) ? second : node + 1;
+            trail >>= 1;
+        }
+
+        if(node == 0 && nodes[0].bounds.importance(p, n) == 0.f)
+            return 0.f;
+
+        return pmf;
+    }
+    bool LightSampler::find(const Ray& r, float t, uint32_t& index) const
+    {
+        // The light is one of those whose box the ray crosses around
+        // that distance, and the ray must hit it there too: the boxes
+        // are walked down from the root, and only the lights of the
+        // leaves reached are tested. The window allows for rounding
+        // errors, the light being intersected on its own rather than
+        // through the scene.
+        auto t0 = t*(1.f - 1e-3f), t1 = t*(1.f + 1e-3f);
+
+        auto found = [&](uint32_t i)
+        {
+            if(!lights[i]->occluded(r, t0, t1))
+                return false;
+
+            index = i;
+            return true;
+        };
+
+        if(!nodes.empty())
+        {
+            // One entry at most for each level above the current node
+            // (see `max_depth`).
+            uint32_t stack[max_depth];
+            uint32_t top = 0;
+            uint32_t node = 0;
+
+            while(true)
+            {
+                const auto& current = nodes[node];
+                if(current.bounds.box.hit(r, t0, t1))
+                {
+                    if(!current.leaf)
+                    {
+                        stack[top++] = current.index;
+                        node = node + 1;
+                        continue;
+                    }
+
+                    if(found(current.index))
+                        return true;
+                }
+
+                if(top == 0)
+                    break;
+                node = stack[--top];
+            }
+        }
+
+        return std::any_of(unbounded.begin(), unbounded.end(), found);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,143 @@
+
+#pragma once
+
+#include "Hittable.hpp"
+
+namespace Ilya
+{
+    /// @brief Lights of the scene, picked according to their
+    /// contribution
+    ///
+    /// Sampling a light at each bounce (see `Renderer::direct_light()`)
+    /// starts by picking one of the lights. Picking them uniformly
+    /// sends as many rays towards a dim light as towards the brightest
+    /// one. Without the tree, each light is picked with a probability
+    /// proportional to its power (see `Hittable::power()`), in constant
+    /// time with an alias table: the n lights are spread over n bins of
+    /// equal probability, each bin holding at most two lights, its own
+    /// and an "alias", with the probability of keeping its own. One
+    /// random number picks the bin, and then one of its two lights.
+    ///
+    /// With thousands of lights, most of them are far from the point
+    /// being shaded, or turned away from it, and the power alone wastes
+    /// most of the samples on them. The tree is a BVH over the lights,
+    /// each node holding the `LightBounds` of the lights below it:
+    /// the light is picked by going down from the root, choosing
+    /// between the two children of each node in proportion to the
+    /// light they can send to the point at most (their importance),
+    /// so that the lights that matter at that point are picked often,
+    /// and the others rarely, however many there are.
+    ///
+    /// Objects that don't emit light are never picked, unless none of
+    /// the objects emits, in which case they are all given the same
+    /// power. Lights without bounds are left out of the tree, and
+    /// picked apart from it with a fixed probability, as pbrt does for
+    /// infinite lights: each of them as often as the whole tree. The
+    /// tree is built even when the lights are picked by power, to find
+    /// which light a ray has hit (see `find()`).
+    class LightSampler
+    {
+        public:
+
+            LightSampler() = default;
+
+            /// Sampler of `lights`, picked with the tree if `tree`, and
+            /// by their power alone otherwise.
+            explicit LightSampler(const std::vector<Ref<Hittable>>& lights, bool tree = true);
+
+            /// Pick the light that lights the point `p` of a surface of
+            /// normal `n` (zero in a medium) with the random number `u`
+            /// in [0, 1[: its index goes in `index` and the probability
+            /// to pick it in `pmf`. Returns false if no light can reach
+            /// the point.
+            bool sample(const Point3& p, const Vec3& n, float u,
+                        uint32_t& index, float& pmf) const;
+
+            /// Probability to pick the light `index` for the point `p`
+            /// of a surface of normal `n`.
+            float pmf(const Point3& p, const Vec3& n, uint32_t index) const;
+
+            /// Find the light that the ray `r` hits at the distance `t`,
+            /// where an emissive surface was found, and put its index
+            /// in `index`. Returns false if that surface is not one of
+            /// the lights.
+            bool find(const Ray& r, float t, uint32_t& index) const;
+
+            const Hittable& operator[](uint32_t index) const
+            {
+                return *lights[index];
+            }
+
+            bool empty() const { return lights.empty(); }
+            uint32_t size() const { return static_cast<uint32_t>(lights.size()); }
+
+        public:
+
+            std::vector<Ref<Hittable>> lights;
+
+            /// Number of buckets in which the lights are binned along
+            /// each axis to pick the split of a node of the tree.
+            static constexpr uint32_t buckets = 12;
+
+        private:
+
+            /// Bin of the alias table: probability to keep the light of
+            /// the bin rather than taking its alias.
+            struct Bin
+            {
+                float keep;
+                uint32_t alias;
+            };
+
+            /// Node of the tree. Nodes are stored depth-first, so the
+            /// first child of a node comes right after it; `index` is
+            /// its second child, or the light of a leaf.
+            struct Node
+            {
+                LightBounds bounds;
+                uint32_t index;
+                bool leaf;
+            };
+
+            /// Light of the tree under construction: its index and its
+            /// light bounds.
+            struct Light
+            {
+                uint32_t index;
+                LightBounds bounds;
+            };
+
+            /// Build the subtree over the lights [start, end[ of `prims`
+            /// (reordered in place) at `depth`; `trail` holds the choice
+            /// of child (0 or 1) at each level above it, bit i for
+            /// level i. Returns the index of its root node.
+            uint32_t build(std::vector<Light>& prims, size_t start, size_t end,
+                           uint64_t trail, uint32_t depth);
+
+            void build_alias(const std::vector<float>& weights);
+
+            /// Probability that the tree sampling picks one of the
+            /// `unbounded` lights rather than going down the tree.
+            float unbounded_pmf() const;
+
+            bool tree = false;
+
+            std::vector<Bin> bins;
+            std::vector<float> pmfs;
+
+            std::vector<Node> nodes;
+
+            /// Lights that can be picked but are out of the tree (see
+            /// `unbounded_pmf()`).
+            std::vector<uint32_t> unbounded;
+
+            /// Path from the root to the leaf of each light (see
+            /// `build()`), or `no_trail` for the lights out of the tree.
+            std::vector<uint64_t> trails;
+            static constexpr uint64_t no_trail = ~0ull;
+
+            /// Maximum depth of the leaves: a trail has one bit per
+            /// level, and a full one would be `no_trail`.
+            static constexpr uint32_t max_depth = 63;
+    };
+}
\ No newline at end of file
@@ -1,7 +1,6 @@
 
 #include "Material.hpp"
 #include "Hittable.hpp"
-#include "Utils/PDF.hpp"
 
 namespace Ilya
 {
@@ -47,8 +46,14 @@ namespace Ilya
         // any given direction at an angle theta from above the
         // scattering point is then given by I = I0*cos(theta), which is
         // Lambert's cosine law.
-        scatter.pdf = std::make_shared<CosinePDF>(rec.normal);
-        scatter.albedo = albedo->val(rec.u, rec.v, rec.p);
+        return scatter_albedo(albedo->val(rec.u, rec.v, rec.p), scatter, rec);
+    }
+
+    bool Lambertian::scatter_albedo(const Color& albedo, ScatterRecord& scatter,
+                                    const HitRecord& rec)
+    {
+        scatter.pdf = CosinePDF{rec.normal};
+        scatter.albedo = albedo;
         scatter.is_specular = false;
 
         return true;
@@ -84,7 +89,6 @@ namespace Ilya
 
         scatter.albedo = albedo;
         scatter.is_specular = true;
-        scatter.pdf = nullptr;
 
         return true;
     }
@@ -134,7 +138,6 @@ namespace Ilya
         scatter.ray = {rec.p, dir, in.cast_time};
         scatter.albedo = Color::White;
         scatter.is_specular = true;
-        scatter.pdf = nullptr;
 
         return true;
     }
@@ -142,17 +145,28 @@ namespace Ilya
     bool Isotropic::scatter(const Ray& in, ScatterRecord& scatter,
                             const HitRecord& rec) const
     {
-        // Rays are scattered off uniformly in all directions, so the
-        // direction of the scattered ray is simply a point in the unit
-        // sphere.
-        scatter.ray = {rec.p, Random::in_unit_sphere(), in.cast_time};
-        scatter.albedo = albedo->val(rec.u, rec.v, rec.p);
+        return scatter_albedo(albedo->val(rec.u, rec.v, rec.p), scatter);
+    }
+
+    bool Isotropic::scatter_albedo(const Color& albedo, ScatterRecord& scatter)
+    {
+        // Rays are scattered off uniformly in all directions: the
+        // integrator draws the direction from the PDF, as for any
+        // scattering that isn't specular.
+        scatter.albedo = albedo;
         scatter.is_specular = false;
-        scatter.pdf = nullptr;
+        scatter.pdf = SpherePDF{};
 
         return true;
     }
 
+    float Isotropic::scattering_pdf(const Ray& in, const Ray& out,
+                                    const HitRecord& rec) const
+    {
+        // Every direction is equally likely, over the whole sphere.
+        return 1.f/(4.f*pi);
+    }
+
     Color DiffuseLight::emitted(float u, float v, const Point3& p,
                                 const HitRecord& rec) const
     {
@@ -163,4 +177,38 @@ namespace Ilya
 
         return emitter->val(u, v, p);
     }
+
+    Color DiffuseLight::emission() const
+    {
+        // The emitter is averaged over a grid of UV coordinates, which
+        // is exact for solid colors, and close enough for the other
+        // textures to compare lights between them.
+        constexpr int n = 4;
+
+        Color sum {0.f};
+        for (int i = 0; i < n; ++i)
+        {
+            for (int j = 0; j < n; ++j)
+                sum += emitter->val((i + 0.5f)/n, (j + 0.5f)/n, {});
+        }
+
+        return sum/(n*n);
+    }
+
+    std::vector<Ref<Material>> MaterialTable::materials;
+    std::unordered_map<const Material*, uint32_t> MaterialTable::indices;
+    std::mutex MaterialTable::mutex;
+
+    uint32_t MaterialTable::add(const Ref<Material>& mat)
+    {
+        std::scoped_lock lock {mutex};
+
+        // The same material is usually shared by many objects, which
+        // all get the same index.
+        auto [it, inserted] = indices.try_emplace(mat.get(), size());
+        if(inserted)
+            materials.push_back(mat);
+
+        return it->second;
+    }
 }
\ No newline at end of file
@@ -3,20 +3,24 @@
 
 #include "Ray.hpp"
 #include "Texture.hpp"
+#include "Utils/PDF.hpp"
+
+#include <mutex>
+#include <unordered_map>
 
 namespace Ilya
 {
     struct HitRecord;
-    class PDF;
 
     /// Struct containing information on the scattering ray as well as
-    /// the material's albedo, PDF and specularity.
+    /// the material's albedo, PDF and specularity. The PDF is stored by
+    /// value, so that scattering doesn't allocate anything.
     struct ScatterRecord
     {
         Ray ray {};
         Color albedo {};
         bool is_specular;
-        Ref<PDF> pdf;
+        ScatterPDF pdf;
     };
 
     class Material
@@ -30,6 +34,14 @@ namespace Ilya
                 return {};
             }
 
+            /// Average color emitted by the material over its surface,
+            /// used to weigh the lights by the power they emit (see
+            /// `LightSampler`).
+            virtual Color emission() const
+            {
+                return {};
+            }
+
             /// Function that tells if the ray `in` scatters off the
             /// surface of the material and puts that information on
             /// the scatter and hit records.
@@ -50,7 +62,7 @@ namespace Ilya
 
     /// Ideal diffuse reflection, where rays scatter uniformly in random
     /// directions off the surface.
-    class Lambertian: public Material
+    class Lambertian final: public Material
     {
         public:
 
@@ -63,6 +75,12 @@ namespace Ilya
             float scattering_pdf(const Ray& in, const Ray& out,
                                  const HitRecord& rec) const override;
 
+            /// Scatter off a Lambertian surface whose albedo texture
+            /// gives `albedo` at the hit point (this is `scatter()`
+            /// once the texture is evaluated).
+            static bool scatter_albedo(const Color& albedo, ScatterRecord& scatter,
+                                       const HitRecord& rec);
+
         public:
 
             Ref<Texture> albedo;
@@ -71,7 +89,7 @@ namespace Ilya
     /// Specular reflection: the rays scatter off the surface at the same
     /// angle with which they arrived. The fuziness parameter adds a bit
     /// of diffusivity to the material, so the metal has a more matte look.
-    class Metal: public Material
+    class Metal final: public Material
     {
         public:
 
@@ -101,7 +119,7 @@ namespace Ilya
     /// the one allowing for a number of dielectrics to be transparent:
     /// light is able to pass through the material, to an extent, making
     /// things visible on both sides.
-    class Dielectric: public Material
+    class Dielectric final: public Material
     {
         public:
 
@@ -129,7 +147,7 @@ namespace Ilya
 
     /// A material that produces diffuse light, that is, light going in
     /// all directions in a random way.
-    class DiffuseLight: public Material
+    class DiffuseLight final: public Material
     {
         public:
 
@@ -159,6 +177,8 @@ namespace Ilya
             Color emitted(float u, float v, const Point3& p,
                           const HitRecord& rec) const override;
 
+            Color emission() const override;
+
         public:
 
             Ref<Texture> emitter;
@@ -168,7 +188,7 @@ namespace Ilya
     /// the case for constant density mediums, for example, like some smoke
     /// or a fog, which are traversed by rays until they hit a particle of
     /// the medium and scatter in a random direction.
-    class Isotropic: public Material
+    class Isotropic final: public Material
     {
         public:
 
@@ -181,8 +201,59 @@ namespace Ilya
             bool scatter(const Ray& in, ScatterRecord& scatter,
                     const HitRecord& rec) const override;
 
+            float scattering_pdf(const Ray& in, const Ray& out,
+                                 const HitRecord& rec) const override;
+
+            /// Scatter off an isotropic medium whose albedo texture
+            /// gives `albedo` at the hit point (this is `scatter()`
+            /// once the texture is evaluated).
+            static bool scatter_albedo(const Color& albedo, ScatterRecord& scatter);
+
         public:
 
             Ref<Texture> albedo;
     };
+
+    /// @brief Materials of the scene, referred to by index
+    ///
+    /// Hittables register their material here when they are created,
+    /// and then only keep its index, which is what they put in the hit
+    /// records: copying an index is free, whereas copying a
+    /// `Ref<Material>` (which happens each time an object is hit, and
+    /// each time a closer hit replaces the current one) updates an
+    /// atomic reference count. The table keeps the materials alive
+    /// until the end of the program. Materials are registered while
+    /// building the scene, and only read while rendering.
+    class MaterialTable
+    {
+        public:
+
+            /// Index of `mat` in the table, which is added to it if it
+            /// isn't there yet.
+            static uint32_t add(const Ref<Material>& mat);
+
+            static const Material& get(uint32_t idx)
+            {
+                return *materials[idx];
+            }
+
+            /// Material registered at `idx`, which may be null for
+            /// objects that are never hit (like the ones only used to
+            /// sample the lights).
+            static const Ref<Material>& at(uint32_t idx)
+            {
+                return materials[idx];
+            }
+
+            static uint32_t size()
+            {
+                return static_cast<uint32_t>(materials.size());
+            }
+
+        private:
+
+            static std::vector<Ref<Material>> materials;
+            static std::unordered_map<const Material*, uint32_t> indices;
+            static std::mutex mutex;
+    };
 }
\ No newline at end of file
@@ -0,0 +1,889 @@
+
+#include "MeshLoader.hpp"
+
+#include "Core/MappedFile.hpp"
+#include "Core/Parallel.hpp"
+
+#include <bit>
+#include <charconv>
+#include <cstring>
+
+namespace Ilya
+{
+    /// Buffers of the mesh being loaded, which are moved into the
+    /// `TriangleMesh` once complete.
+    struct MeshData
+    {
+        std::vector<Point3> positions;
+        std::vector<Vec3> normals;
+        std::vector<Vec2> uvs;
+        std::vector<uint32_t> indices;
+    };
+
+    /// Files are parsed in parallel by parts of about this size, or
+    /// this number of elements for binary files.
+    static constexpr size_t chunk_bytes = 1 << 20;
+    static constexpr size_t chunk_elements = 1 << 16;
+
+    static constexpr uint32_t no_index = std::numeric_limits<uint32_t>::max();
+
+    static bool blank(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    static void skip_blanks(const char*& p, const char* end)
+    {
+        while(p < end && blank(*p))
+            ++p;
+    }
+
+    static float parse_float(const char*& p, const char* end)
+    {
+        skip_blanks(p, end);
+        if(p < end && *p == '+')
+            ++p;
+
+        float x = 0.f;
+        p = std::from_chars(p, end, x).ptr;
+        return x;
+    }
+
+    /// Kinds of OBJ lines that make up a mesh; everything else
+    /// (groups, materials, comments...) is skipped.
+    enum class ObjLine { Position, Normal, UV, Face, Other };
+
+    /// Type of the line starting at `p`, which is moved past the
+    /// keyword.
+    static ObjLine obj_line(const char*& p, const char* eol)
+    {
+        if(eol - p < 2)
+            return ObjLine::Other;
+
+        if(p[0] == 'f' && blank(p[1]))
+        {
+            p += 1;
+            return ObjLine::Face;
+        }
+
+        if(p[0] != 'v')
+            return ObjLine::Other;
+
+        if(blank(p[1]))
+        {
+            p += 1;
+            return ObjLine::Position;
+        }
+
+        if(eol - p > 2 && blank(p[2]) && (p[1] == 'n' || p[1] == 't'))
+        {
+            p += 2;
+            return p[-1] == 'n' ? ObjLine::Normal : ObjLine::UV;
+        }
+
+        return ObjLine::Other;
+    }
+
+    /// Part of an OBJ file parsed by one thread, between two line
+    /// breaks. The first pass counts the elements it holds, which gives
+    /// the offsets in the mesh buffers at which the second pass writes
+    /// them (the number of elements in the previous chunks).
+    struct ObjChunk
+    {
+        const char* begin;
+        const char* end;
+
+        // Counts (first pass), then offsets (second pass), indexed by
+        // position, UV and normal like the indices of a face corner.
+        uint32_t elements[3] {};
+        uint32_t triangles = 0;
+
+        // Whether all corners have a UV and a normal, and whether those
+        // have the same index as the position.
+        bool all_uvs = true, all_normals = true;
+        bool shared_indices = true;
+        bool valid = true;
+    };
+
+    /// Call `func(type, p, end)` on each line of `chunk`, with `p` past
+    /// the keyword of the line and `end` at its end or at the start of
+    /// a trailing comment, so that "f 1 2 3 # quad" has three corners.
+    static void for_each_line(const ObjChunk& chunk, auto func)
+    {
+        for (auto p = chunk.begin; p < chunk.end;)
+        {
+            auto eol = static_cast<const char*>(std::memchr(p, '\n', chunk.end - p));
+            if(!eol)
+                eol = chunk.end;
+
+            auto end = static_cast<const char*>(std::memchr(p, '#', eol - p));
+            if(!end)
+                end = eol;
+
+            skip_blanks(p, end);
+            auto type = obj_line(p, end);
+            if(type != ObjLine::Other)
+                func(type, p, end);
+
+            p = eol + 1;
+        }
+    }
+
+    /// Parse the next corner of a face at `p`, "v", "v/vt", "v//vn" or
+    /// "v/vt/vn", into 0-based indices (`no_index` for the missing
+    /// ones). Indices are 1-based in the file, and negative ones count
+    /// back from the last element read before the face (`seen`); they
+    /// must be less than the number of elements in the file (`total`).
+    /// Returns false at the end of the line.
+    static bool parse_corner(const char*& p, const char* eol, const uint32_t seen[3],
+                             const uint32_t total[3], uint32_t corner[3], bool& valid)
+    {
+        skip_blanks(p, eol);
+        if(p >= eol)
+            return false;
+
+        for (int k = 0; k < 3; ++k)
+        {
+            corner[k] = no_index;
+            if(k > 0)
+            {
+                if(p >= eol || *p != '/')
+                    continue;
+                ++p;
+            }
+
+            int64_t i = 0;
+            auto [next, ec] = std::from_chars(p, eol, i);
+            if(ec != std::errc{})
+            {
+                valid &= (k > 0);
+                continue;
+            }
+
+            p = next;
+            auto idx = (i > 0) ? i - 1 : int64_t(seen[k]) + i;
+            if(i == 0 || idx < 0 || idx >= total[k])
+                valid = false;
+            else
+                corner[k] = static_cast<uint32_t>(idx);
+        }
+
+        // Skip whatever is left of a malformed corner.
+        if(p < eol && !blank(*p))
+        {
+            valid = false;
+            while(p < eol && !blank(*p))
+                ++p;
+        }
+
+        return true;
+    }
+
+    /// Turn the corners of the faces, which may have a different index
+    /// for their position, UV and normal in OBJ files, into vertices
+    /// with a single index for all three, as the mesh needs. Each new
+    /// vertex is a distinct combination of the three indices: they are
+    /// found by chaining the vertices that share a position, which is
+    /// a short list (the corners of a UV seam or a sharp edge).
+    static void unify_vertices(MeshData& mesh, const std::vector<Vec2>& uvs,
+                               const std::vector<Vec3>& normals,
+                               const std::vector<uint32_t>& corner_uv,
+                               const std::vector<uint32_t>& corner_normal)
+    {
+        std::vector<uint32_t> head(mesh.positions.size(), no_index);
+        std::vector<uint32_t> next, position, uv, normal;
+        next.reserve(mesh.positions.size());
+        position.reserve(mesh.positions.size());
+        uv.reserve(uvs.empty() ? 0 : mesh.positions.size());
+        normal.reserve(normals.empty() ? 0 : mesh.positions.size());
+
+        for (size_t k = 0; k < mesh.indices.size(); ++k)
+        {
+            auto p = mesh.indices[k];
+            auto t = uvs.empty() ? 0 : corner_uv[k];
+            auto n = normals.empty() ? 0 : corner_normal[k];
+
+            auto v = head[p];
+            while(v != no_index && ((!uvs.empty() && uv[v] != t) || (!normals.empty() && normal[v] != n)))
+                v = next[v];
+
+            if(v == no_index)
+            {
+                v = static_cast<uint32_t>(position.size());
+                position.push_back(p);
+                if(!uvs.empty())
+                    uv.push_back(t);
+                if(!normals.empty())
+                    normal.push_back(n);
+
+                next.push_back(head[p]);
+                head[p] = v;
+            }
+
+            mesh.indices[k] = v;
+        }
+
+        auto count = static_cast<uint32_t>(position.size());
+        std::vector<Point3> positions(count);
+        mesh.uvs.resize(uvs.empty() ? 0 : count);
+        mesh.normals.resize(normals.empty() ? 0 : count);
+
+        parallel_for(static_cast<uint32_t>((count + chunk_elements - 1)/chunk_elements), [&](uint32_t block)
+        {
+            auto first = block*chunk_elements;
+            auto last = std::min<size_t>(first + chunk_elements, count);
+            for (auto v = first; v < last; ++v)
+            {
+                positions[v] = mesh.positions[position[v]];
+                if(!uvs.empty())
+                    mesh.uvs[v] = uvs[uv[v]];
+                if(!normals.empty())
+                    mesh.normals[v] = normals[normal[v]];
+            }
+        });
+
+        mesh.positions = std::move(positions);
+    }
+
+    static bool load_obj(std::string_view file, MeshData& mesh)
+    {
+        // Split the file in chunks starting at line beginnings.
+        auto count = std::max<size_t>(1, file.size()/chunk_bytes);
+        std::vector<ObjChunk> chunks(count);
+
+        auto line_start = [&](size_t offset)
+        {
+            if(offset == 0)
+                return file.data();
+
+            auto eol = file.find('\n', offset - 1);
+            return (eol == std::string_view::npos) ? file.data() + file.size() : file.data() + eol + 1;
+        };
+
+        for (size_t c = 0; c < count; ++c)
+        {
+            chunks[c].begin = line_start(file.size()*c/count);
+            chunks[c].end = (c + 1 < count) ? line_start(file.size()*(c + 1)/count) : file.data() + file.size();
+        }
+
+        // First pass: count the elements of each chunk.
+        parallel_for(static_cast<uint32_t>(count), [&](uint32_t c)
+        {
+            auto& chunk = chunks[c];
+            for_each_line(chunk, [&](ObjLine type, const char* p, const char* eol)
+            {
+                if(type != ObjLine::Face)
+                {
+                    ++chunk.elements[type == ObjLine::Position ? 0 : (type == ObjLine::UV ? 1 : 2)];
+                    return;
+                }
+
+                uint32_t corners = 0;
+                while(true)
+                {
+                    skip_blanks(p, eol);
+                    if(p >= eol)
+                        break;
+
+                    ++corners;
+                    while(p < eol && !blank(*p))
+                        ++p;
+                }
+
+                chunk.triangles += (corners >= 3) ? corners - 2 : 0;
+            });
+        });
+
+        // Turn the counts into offsets.
+        uint32_t total[3] {};
+        uint32_t triangles = 0;
+        for (auto& chunk: chunks)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                auto n = chunk.elements[k];
+                chunk.elements[k] = total[k];
+                total[k] += n;
+            }
+
+            auto n = chunk.triangles;
+            chunk.triangles = triangles;
+            triangles += n;
+        }
+
+        if(triangles == 0)
+            return false;
+
+        mesh.positions.resize(total[0]);
+        mesh.indices.resize(size_t(triangles)*3);
+
+        std::vector<Vec2> uvs(total[1]);
+        std::vector<Vec3> normals(total[2]);
+        std::vector<uint32_t> corner_uv(total[1] ? mesh.indices.size() : 0);
+        std::vector<uint32_t> corner_normal(total[2] ? mesh.indices.size() : 0);
+
+        // Second pass: parse the elements in place.
+        parallel_for(static_cast<uint32_t>(count), [&](uint32_t c)
+        {
+            auto& chunk = chunks[c];
+            auto* seen = chunk.elements;
+            auto t = chunk.triangles;
+
+            for_each_line(chunk, [&](ObjLine type, const char* p, const char* eol)
+            {
+                switch(type)
+                {
+                    case ObjLine::Position:
+                    {
+                        auto x = parse_float(p, eol), y = parse_float(p, eol), z = parse_float(p, eol);
+                        mesh.positions[seen[0]++] = {x, y, z};
+                        break;
+                    }
+                    case ObjLine::UV:
+                    {
+                        auto u = parse_float(p, eol), v = parse_float(p, eol);
+                        uvs[seen[1]++] = {u, v};
+                        break;
+                    }
+                    case ObjLine::Normal:
+                    {
+                        auto x = parse_float(p, eol), y = parse_float(p, eol), z = parse_float(p, eol);
+                        normals[seen[2]++] = {x, y, z};
+                        break;
+                    }
+                    default:
+                    {
+                        // Polygons are split in a fan of triangles
+                        // around their first corner.
+                        uint32_t first[3], prev[3], corner[3];
+                        uint32_t n = 0;
+                        while(parse_corner(p, eol, seen, total, corner, chunk.valid))
+                        {
+                            if(n >= 2)
+                            {
+                                const uint32_t* tri[3] = {first, prev, corner};
+                                for (int k = 0; k < 3; ++k)
+                                {
+                                    auto idx = size_t(t)*3 + k;
+                                    mesh.indices[idx] = tri[k][0];
+                                    if(!corner_uv.empty())
+                                        corner_uv[idx] = tri[k][1];
+                                    if(!corner_normal.empty())
+                                        corner_normal[idx] = tri[k][2];
+
+                                    chunk.all_uvs &= (tri[k][1] != no_index);
+                                    chunk.all_normals &= (tri[k][2] != no_index);
+                                    chunk.shared_indices &= (tri[k][1] == no_index || tri[k][1] == tri[k][0])
+                                                         && (tri[k][2] == no_index || tri[k][2] == tri[k][0]);
+                                }
+
+                                ++t;
+                            }
+
+                            if(n == 0)
+                                std::copy_n(corner, 3, first);
+                            std::copy_n(corner, 3, prev);
+                            ++n;
+                        }
+
+                        break;
+                    }
+                }
+            });
+        });
+
+        bool all_uvs = total[1] > 0, all_normals = total[2] > 0, shared_indices = true;
+        for (const auto& chunk: chunks)
+        {
+            if(!chunk.valid)
+                return false;
+
+            all_uvs &= chunk.all_uvs;
+            all_normals &= chunk.all_normals;
+            shared_indices &= chunk.shared_indices;
+        }
+
+        // UVs and normals are only kept if all the corners have them.
+        if(!all_uvs)
+            uvs.clear();
+        if(!all_normals)
+            normals.clear();
+
+        // When the corners use the same index for all their attributes
+        // (as most exporters write them), the attributes can be used as
+        // they are; otherwise, vertices must be split where a position
+        // is used with several UVs or normals.
+        bool same_counts = (uvs.empty() || uvs.size() == total[0])
+                        && (normals.empty() || normals.size() == total[0]);
+
+        if(uvs.empty() && normals.empty())
+            return true;
+
+        if(shared_indices && same_counts)
+        {
+            mesh.uvs = std::move(uvs);
+            mesh.normals = std::move(normals);
+            return true;
+        }
+
+        unify_vertices(mesh, uvs, normals, corner_uv, corner_normal);
+        return true;
+    }
+
+    /// Types of the properties of a PLY file.
+    enum class PlyType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64, Invalid };
+
+    static constexpr size_t ply_sizes[] = {1, 1, 2, 2, 4, 4, 4, 8, 0};
+
+    static PlyType ply_type(std::string_view name)
+    {
+        static const std::pair<std::string_view, PlyType> names[] = {
+            {"char", PlyType::Int8}, {"int8", PlyType::Int8},
+            {"uchar", PlyType::UInt8}, {"uint8", PlyType::UInt8},
+            {"short", PlyType::Int16}, {"int16", PlyType::Int16},
+            {"ushort", PlyType::UInt16}, {"uint16", PlyType::UInt16},
+            {"int", PlyType::Int32}, {"int32", PlyType::Int32},
+            {"uint", PlyType::UInt32}, {"uint32", PlyType::UInt32},
+            {"float", PlyType::Float32}, {"float32", PlyType::Float32},
+            {"double", PlyType::Float64}, {"float64", PlyType::Float64}
+        };
+
+        for (const auto& [n, type]: names)
+        {
+            if(n == name)
+                return type;
+        }
+
+        return PlyType::Invalid;
+    }
+
+    template<typename T>
+    static T read_as(const char* bytes)
+    {
+        T x;
+        std::memcpy(&x, bytes, sizeof(T));
+        return x;
+    }
+
+    /// Value of type `type` at `p`, whose bytes are reversed if the
+    /// file and the machine don't have the same endianness.
+    static double ply_read(const char* p, PlyType type, bool swap)
+    {
+        char bytes[8];
+        auto size = ply_sizes[int(type)];
+        std::memcpy(bytes, p, size);
+        if(swap)
+            std::reverse(bytes, bytes + size);
+
+        switch(type)
+        {
+            case PlyType::Int8: return read_as<int8_t>(bytes);
+            case PlyType::UInt8: return read_as<uint8_t>(bytes);
+            case PlyType::Int16: return read_as<int16_t>(bytes);
+            case PlyType::UInt16: return read_as<uint16_t>(bytes);
+            case PlyType::Int32: return read_as<int32_t>(bytes);
+            case PlyType::UInt32: return read_as<uint32_t>(bytes);
+            case PlyType::Float32: return read_as<float>(bytes);
+            case PlyType::Float64: return read_as<double>(bytes);
+            default: return 0.0;
+        }
+    }
+
+    struct PlyProperty
+    {
+        std::string name;
+        PlyType type;
+        PlyType count_type = PlyType::Invalid;  // list properties only
+        size_t offset = 0;                      // in fixed-size records
+    };
+
+    /// Element of a PLY file (vertices, faces, or anything else), made
+    /// of `count` records. Records without list properties all have
+    /// the same size, `stride`.
+    struct PlyElement
+    {
+        std::string name;
+        size_t count;
+        std::vector<PlyProperty> properties;
+        size_t stride = 0;
+        bool fixed = true;
+
+        const PlyProperty* find(std::initializer_list<std::string_view> names) const
+        {
+            for (const auto& prop: properties)
+            {
+                for (auto name: names)
+                {
+                    if(prop.name == name)
+                        return &prop;
+                }
+            }
+
+            return nullptr;
+        }
+    };
+
+    /// Read the length of a list at `p` into `n`; fails on malformed
+    /// files, whose (signed or floating-point) lengths can be negative
+    /// or out of range.
+    static bool ply_count(const char* p, PlyType type, bool swap, size_t& n)
+    {
+        auto count = ply_read(p, type, swap);
+        if(!(count >= 0.0 && count <= double(std::numeric_limits<uint32_t>::max())))
+            return false;
+
+        n = static_cast<size_t>(count);
+        return true;
+    }
+
+    /// Size of the record of `element` at `p`, or 0 if it goes past
+    /// `end` or is malformed.
+    static size_t ply_record_size(const PlyElement& element, const char* p, const char* end, bool swap)
+    {
+        size_t size = 0;
+        for (const auto& prop: element.properties)
+        {
+            if(prop.count_type == PlyType::Invalid)
+            {
+                size += ply_sizes[int(prop.type)];
+                continue;
+            }
+
+            auto count_size = ply_sizes[int(prop.count_type)];
+            if(p + size + count_size > end)
+                return 0;
+
+            size_t n;
+            if(!ply_count(p + size, prop.count_type, swap, n))
+                return 0;
+
+            size += count_size + n*ply_sizes[int(prop.type)];
+        }
+
+        return (p + size <= end) ? size : 0;
+    }
+
+    static bool load_ply_vertices(const PlyElement& vertices, const char* data, bool swap, MeshData& mesh)
+    {
+        if(!vertices.fixed)
+            return false;
+
+        const PlyProperty* position[3] = {vertices.find({"x"}), vertices.find({"y"}), vertices.find({"z"})};
+        const PlyProperty* normal[3] = {vertices.find({"nx"}), vertices.find({"ny"}), vertices.find({"nz"})};
+        const PlyProperty* uv[2] = {vertices.find({"u", "s", "texture_u", "texture_s"}),
+                                    vertices.find({"v", "t", "texture_v", "texture_t"})};
+
+        if(!position[0] || !position[1] || !position[2])
+            return false;
+
+        bool has_normals = normal[0] && normal[1] && normal[2];
+        bool has_uvs = uv[0] && uv[1];
+
+        auto count = vertices.count;
+        mesh.positions.resize(count);
+        mesh.normals.resize(has_normals ? count : 0);
+        mesh.uvs.resize(has_uvs ? count : 0);
+
+        auto read = [&](const char* record, const PlyProperty* prop)
+        {
+            return static_cast<float>(ply_read(record + prop->offset, prop->type, swap));
+        };
+
+        parallel_for(static_cast<uint32_t>((count + chunk_elements - 1)/chunk_elements), [&](uint32_t block)
+        {
+            auto first = block*chunk_elements;
+            auto last = std::min(first + chunk_elements, count);
+            for (auto i = first; i < last; ++i)
+            {
+                auto record = data + i*vertices.stride;
+                mesh.positions[i] = {read(record, position[0]), read(record, position[1]), read(record, position[2])};
+                if(has_normals)
+                    mesh.normals[i] = {read(record, normal[0]), read(record, normal[1]), read(record, normal[2])};
+                if(has_uvs)
+                    mesh.uvs[i] = {read(record, uv[0]), read(record, uv[1])};
+            }
+        });
+
+        return true;
+    }
+
+    static bool load_ply_faces(const PlyElement& faces, const char* data, const char* end,
+                               bool swap, size_t vertex_count, MeshData& mesh)
+    {
+        auto list = faces.find({"vertex_indices", "vertex_index"});
+        if(!list || list->count_type == PlyType::Invalid)
+            return false;
+
+        auto count_size = ply_sizes[int(list->count_type)];
+        auto index_size = ply_sizes[int(list->type)];
+
+        auto read_index = [&](const char* p, bool& valid)
+        {
+            auto i = ply_read(p, list->type, swap);
+            valid &= (i >= 0.0 && i < double(vertex_count));
+            return static_cast<uint32_t>(i);
+        };
+
+        // Start of the index list in the face record at `p`, past the
+        // properties before it (whose lengths `ply_record_size()` has
+        // checked, if any).
+        auto list_start = [&](const char* p)
+        {
+            for (auto prop = faces.properties.data(); prop != list; ++prop)
+            {
+                size_t n = 0;
+                if(prop->count_type == PlyType::Invalid)
+                    p += ply_sizes[int(prop->type)];
+                else if(ply_count(p, prop->count_type, swap, n))
+                    p += ply_sizes[int(prop->count_type)] + n*ply_sizes[int(prop->type)];
+            }
+
+            return p;
+        };
+
+        // Nearly all PLY meshes are made of triangles only: when the
+        // index list is the only list of the faces, every face record
+        // then has the same size, and they can be read in parallel like
+        // the vertices. This is checked while reading them, and if a
+        // face turns out not to be a triangle, they are read again one
+        // after the other.
+        bool single_list = std::count_if(faces.properties.begin(), faces.properties.end(), [](const PlyProperty& prop)
+        {
+            return prop.count_type != PlyType::Invalid;
+        }) == 1;
+
+        size_t scalars = 0;
+        for (const auto& prop: faces.properties)
+        {
+            if(&prop != list)
+                scalars += ply_sizes[int(prop.type)];
+        }
+
+        auto stride = scalars + count_size + 3*index_size;
+        if(single_list && faces.count <= size_t(end - data)/stride)
+        {
+            mesh.indices.resize(faces.count*3);
+
+            auto blocks = static_cast<uint32_t>((faces.count + chunk_elements - 1)/chunk_elements);
+            std::vector<uint8_t> triangles(blocks, true), valid(blocks, true);
+
+            parallel_for(blocks, [&](uint32_t block)
+            {
+                auto first = block*chunk_elements;
+                auto last = std::min(first + chunk_elements, faces.count);
+                bool ok = true;
+                for (auto f = first; f < last; ++f)
+                {
+                    auto record = list_start(data + f*stride);
+                    if(ply_read(record, list->count_type, swap) != 3.0)
+                    {
+                        triangles[block] = false;
+                        break;
+                    }
+
+                    for (int k = 0; k < 3; ++k)
+                        mesh.indices[3*f + k] = read_index(record + count_size + k*index_size, ok);
+                }
+
+                valid[block] = ok;
+            });
+
+            if(std::all_of(triangles.begin(), triangles.end(), [](uint8_t t) { return t; }))
+                return std::all_of(valid.begin(), valid.end(), [](uint8_t v) { return v; });
+        }
+
+        // General case: count the triangles of the polygon fans, then
+        // read them.
+        size_t triangles = 0;
+        auto p = data;
+        for (size_t f = 0; f < faces.count; ++f)
+        {
+            auto size = ply_record_size(faces, p, end, swap);
+            size_t n;
+            if(!size || !ply_count(list_start(p), list->count_type, swap, n))
+                return false;
+
+            triangles += (n >= 3) ? n - 2 : 0;
+            p += size;
+        }
+
+        mesh.indices.resize(triangles*3);
+        bool ok = true;
+        size_t t = 0;
+        p = data;
+        for (size_t f = 0; f < faces.count; ++f)
+        {
+            auto size = ply_record_size(faces, p, end, swap);
+            auto q = list_start(p);
+            size_t n = 0;
+            ply_count(q, list->count_type, swap, n);
+
+            q += count_size;
+            for (size_t k = 2; k < n; ++k, ++t)
+            {
+                mesh.indices[3*t] = read_index(q, ok);
+                mesh.indices[3*t + 1] = read_index(q + (k - 1)*index_size, ok);
+                mesh.indices[3*t + 2] = read_index(q + k*index_size, ok);
+            }
+
+            p += size;
+        }
+
+        return ok;
+    }
+
+    static bool load_ply(std::string_view file, MeshData& mesh)
+    {
+        // The header is text, one keyword per line: the format, then
+        // each element with its number of records and its properties,
+        // in the order in which they are stored.
+        auto header_end = file.find("end_header");
+        if(file.substr(0, 3) != "ply" || header_end == std::string_view::npos)
+            return false;
+
+        auto data_start = file.find('\n', header_end);
+        if(data_start == std::string_view::npos)
+            return false;
+
+        bool swap = false, binary = false;
+        std::vector<PlyElement> elements;
+
+        auto header = file.substr(0, header_end);
+        for (size_t pos = 0; pos < header.size();)
+        {
+            auto eol = std::min(header.find('\n', pos), header.size());
+            auto line = header.substr(pos, eol - pos);
+            pos = eol + 1;
+
+            std::vector<std::string_view> words;
+            for (size_t w = 0; w < line.size();)
+            {
+                while(w < line.size() && blank(line[w]))
+                    ++w;
+                auto start = w;
+                while(w < line.size() && !blank(line[w]))
+                    ++w;
+                if(w > start)
+                    words.push_back(line.substr(start, w - start));
+            }
+
+            if(words.empty())
+                continue;
+
+            if(words[0] == "format" && words.size() > 1)
+            {
+                binary = (words[1] != "ascii");
+                swap = (words[1] == "binary_big_endian") != (std::endian::native == std::endian::big);
+            }
+            else if(words[0] == "element" && words.size() > 2)
+            {
+                PlyElement element {std::string(words[1]), 0, {}, 0, true};
+                std::from_chars(words[2].data(), words[2].data() + words[2].size(), element.count);
+                elements.push_back(element);
+            }
+            else if(words[0] == "property" && !elements.empty())
+            {
+                auto& element = elements.back();
+                PlyProperty prop;
+                if(words.size() > 4 && words[1] == "list")
+                {
+                    prop = {std::string(words[4]), ply_type(words[3]), ply_type(words[2])};
+                    element.fixed = false;
+                    if(prop.count_type == PlyType::Invalid)
+                        return false;
+                }
+                else if(words.size() > 2)
+                    prop = {std::string(words[2]), ply_type(words[1])};
+                else
+                    return false;
+
+                if(prop.type == PlyType::Invalid)
+                    return false;
+
+                prop.offset = element.stride;
+                element.stride += ply_sizes[int(prop.type)];
+                element.properties.push_back(prop);
+            }
+        }
+
+        if(!binary)
+        {
+            error("ERROR: only binary PLY files are supported\n");
+            return false;
+        }
+
+        // Go through the elements in order, skipping the ones that are
+        // neither vertices nor faces; those can come in either order.
+        auto p = file.data() + data_start + 1;
+        auto end = file.data() + file.size();
+        auto vertices = std::find_if(elements.begin(), elements.end(), [](const PlyElement& e) { return e.name == "vertex"; });
+        if(vertices == elements.end())
+            return false;
+
+        bool has_faces = false;
+        for (const auto& element: elements)
+        {
+            // The count comes from the header: compare it to what is
+            // left of the file without multiplying, which could wrap.
+            if(element.fixed && element.stride > 0 && element.count > size_t(end - p)/element.stride)
+                return false;
+
+            if(element.name == "vertex")
+            {
+                if(!load_ply_vertices(element, p, swap, mesh))
+                    return false;
+            }
+            else if(element.name == "face")
+            {
+                if(!load_ply_faces(element, p, end, swap, vertices->count, mesh))
+                    return false;
+
+                has_faces = true;
+            }
+
+            if(element.fixed)
+            {
+                p += element.count*element.stride;
+                continue;
+            }
+
+            for (size_t i = 0; i < element.count; ++i)
+            {
+                auto size = ply_record_size(element, p, end, swap);
+                if(!size)
+                    return false;
+                p += size;
+            }
+        }
+
+        return has_faces && !mesh.positions.empty() && !mesh.indices.empty();
+    }
+
+    Ref<TriangleMesh> load_mesh(const std::string& path, const Ref<Material>& mat)
+    {
+        auto fullpath = res_path/path;
+        auto extension = fullpath.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return std::tolower(c); });
+
+        if(extension != ".obj" && extension != ".ply")
+        {
+            error("ERROR: unknown mesh format for file at path {}\n", fullpath.string());
+            return nullptr;
+        }
+
+        MappedFile file {fullpath};
+        if(!file)
+            return nullptr;
+
+        MeshData mesh;
+        bool loaded = (extension == ".obj") ? load_obj(file.view(), mesh) : load_ply(file.view(), mesh);
+        if(!loaded)
+        {
+            error("ERROR: could not read mesh file at path {}\n", fullpath.string());
+            return nullptr;
+        }
+
+        return std::make_shared<TriangleMesh>(std::move(mesh.positions), std::move(mesh.indices), mat,
+                                              std::move(mesh.normals), std::move(mesh.uvs));
+    }
+}
\ No newline at end of file
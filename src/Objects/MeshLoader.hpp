@@ -0,0 +1,19 @@
+
+#pragma once
+
+#include "TriangleMesh.hpp"
+
+namespace Ilya
+{
+    /// @brief Load a triangle mesh from a file
+    ///
+    /// Reads a Wavefront OBJ (.obj) or binary PLY (.ply) file at `path`,
+    /// relative to the resource directory (as for `ImageTexture`), into
+    /// a `TriangleMesh` with the material `mat`. Polygons are split in
+    /// triangle fans; positions are always read, and normals and UVs
+    /// when every vertex has them. The file is memory-mapped and parsed
+    /// by chunks on all the threads, each chunk writing its vertices
+    /// and indices directly in their final place in the mesh buffers.
+    /// Prints an error and returns nullptr if the file can't be read.
+    Ref<TriangleMesh> load_mesh(const std::string& path, const Ref<Material>& mat);
+}
\ No newline at end of file
@@ -12,7 +12,9 @@ namespace Ilya
 
             Ray() = default;
             Ray(const Point3& orig, const Vec3& dir, float time = 0.f):
-                    orig(orig), dir(dir), cast_time(time) {}
+                    orig(orig), dir(dir), cast_time(time),
+                    inv_dir(1.f/dir.x, 1.f/dir.y, 1.f/dir.z),
+                    dir_is_neg{std::signbit(dir.x), std::signbit(dir.y), std::signbit(dir.z)} {}
             Ray(const Ray& r) = default;
 
             Point3 operator()(float t) const
@@ -25,5 +27,15 @@ namespace Ilya
             Point3 orig;
             Vec3 dir;
             float cast_time;
+
+            /// Inverse of the direction components and whether they
+            /// are negative, which bounding box tests need for every
+            /// box the ray is tested against, and are thus computed
+            /// once and for all when the ray is created (a direction
+            /// component of 0 gives an infinite inverse, which the box
+            /// tests handle, as long as the sign of the direction is
+            /// the sign of that infinity: -0 counts as negative).
+            Vec3 inv_dir;
+            bool dir_is_neg[3];
     };
 }
\ No newline at end of file
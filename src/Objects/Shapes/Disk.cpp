@@ -0,0 +1,93 @@
+
+#include "Disk.hpp"
+
+namespace Ilya::Shapes
+{
+    Disk::Disk(float height, float radius, float inner_radius, float phimax,
+               const Ref<Transform>& objtoworld, bool reverse_orientation):
+            Shape(objtoworld, reverse_orientation), height(height),
+            radius(radius), inner_radius(glm::clamp(inner_radius, 0.f, radius))
+    {
+        phiMax = glm::radians(glm::clamp(phimax, 0.f, 360.f));
+    }
+
+    Bounds Disk::objspace_bounds() const
+    {
+        // As for `Rectangle`, the box cannot have zero width, so we
+        // leave a little room around the plane of the disk.
+        return {{-radius, -radius, height - 0.0001f},
+                {radius, radius, height + 0.0001f}};
+    }
+
+    float Disk::area() const
+    {
+        return phiMax*0.5f*(radius*radius - inner_radius*inner_radius);
+    }
+
+    bool Disk::intersect(const Ray& ray, float tmin, float tmax, float& t,
+                         Point3& p, float& dist2, float& phi) const
+    {
+        // In object space, the ray hits the plane of the disk where
+        // its z coordinate is the height of the disk; it never does
+        // if it is parallel to it.
+        if(ray.dir.z == 0.f)
+            return false;
+
+        t = (height - ray.orig.z)/ray.dir.z;
+        if(t <= tmin || t > tmax)
+            return false;
+
+        // The hit point must then be between the inner and outer
+        // radii, and before the angle phiMax.
+        p = ray(t);
+        dist2 = p.x*p.x + p.y*p.y;
+        if(dist2 > radius*radius || dist2 < inner_radius*inner_radius)
+            return false;
+
+        phi = std::atan2(p.y, p.x);
+        if(phi < 0.f)
+            phi += 2*pi;
+
+        return phi <= phiMax;
+    }
+
+    bool Disk::occluded(const Ray& r, float tmin, float tmax) const
+    {
+        float t, dist2, phi;
+        Point3 p;
+        return intersect((*worldtoobj)(r), tmin, tmax, t, p, dist2, phi);
+    }
+
+    bool Disk::hit(const Ray& r, float tmin, float tmax, float& t,
+                   SurfaceInteraction& isect) const
+    {
+        auto ray = (*worldtoobj)(r);
+        float t_hit, dist2, phi;
+        Point3 p;
+        if(!intersect(ray, tmin, tmax, t_hit, p, dist2, phi))
+            return false;
+
+        // The position moves around z with u and towards the center
+        // with v; the disk is flat, so the normal doesn't change.
+        auto r_hit = std::sqrt(dist2);
+        auto u = phi/phiMax;
+        auto v = (radius - r_hit)/(radius - inner_radius);
+
+        auto radial = r_hit > 0.f ? Vec3{p.x, p.y, 0.f}/r_hit : Vec3{1.f, 0.f, 0.f};
+        auto dpdu = Vec3{-phiMax*p.y, phiMax*p.x, 0.f};
+        auto dpdv = (inner_radius - radius)*radial;
+
+        // At the very center of a full disk, dp/du vanishes; any
+        // tangent orthogonal to dp/dv gives the right normal.
+        if(r_hit == 0.f)
+            dpdu = Vec3{0.f, 1.f, 0.f};
+
+        p.z = height;
+
+        SurfaceElement element {dpdu, dpdv, Normal{0.f, 0.f, 0.f}, Normal{0.f, 0.f, 0.f}};
+        isect = to_world({p, -ray.dir, {u, v}, element, ray.cast_time});
+        t = t_hit;
+
+        return true;
+    }
+}
\ No newline at end of file
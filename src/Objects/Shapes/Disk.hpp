@@ -0,0 +1,50 @@
+
+#pragma once
+
+#include "Shape.hpp"
+#include "Objects/Bounds.hpp"
+
+namespace Ilya::Shapes
+{
+    /// @brief Disk centered on the z axis of its object space
+    ///
+    /// The disk lies in the plane z = `height`, facing +z, and can be
+    /// an annulus (with a hole of radius `inner_radius`) and partial
+    /// (swept only up to the angle `phiMax` around z). The surface is
+    /// parametrized by u = phi/phiMax, and v going from 0 on the outer
+    /// edge to 1 on the inner one.
+    class Disk final: public Shape
+    {
+        public:
+
+            Disk(float height, float radius, float inner_radius, float phimax,
+                 const Ref<Transform>& objtoworld, bool reverse_orientation);
+
+            /// Full disk of radius `radius` at the origin.
+            Disk(float radius, const Ref<Transform>& objtoworld,
+                 bool reverse_orientation = false):
+                Disk(0.f, radius, 0.f, 360.f, objtoworld, reverse_orientation) {}
+
+            Bounds objspace_bounds() const override;
+
+            bool hit(const Ray& r, float tmin, float tmax, float& t,
+                     SurfaceInteraction& isect) const override;
+            bool occluded(const Ray& r, float tmin, float tmax) const override;
+
+            float area() const override;
+
+        public:
+
+            const float height, radius, inner_radius;
+            float phiMax;
+
+        private:
+
+            /// Distance `t` and point `p` of the intersection of the
+            /// ray `ray` (in object space) with the disk between `tmin`
+            /// and `tmax`, if any, with the squared distance of `p` to
+            /// the z axis in `dist2` and its angle around it in `phi`.
+            bool intersect(const Ray& ray, float tmin, float tmax, float& t,
+                           Point3& p, float& dist2, float& phi) const;
+    };
+}
\ No newline at end of file
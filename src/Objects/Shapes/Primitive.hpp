@@ -0,0 +1,161 @@
+
+#pragma once
+
+#include "Shape.hpp"
+#include "Objects/BVH.hpp"
+#include "Core/Parallel.hpp"
+
+namespace Ilya
+{
+    /// Fill the hit record `rec` of the ray `r` from the surface
+    /// interaction `isect` found at the distance `t` on a shape with
+    /// the material `material`.
+    inline void shape_record(const Ray& r, float t, const SurfaceInteraction& isect,
+                             uint32_t material, HitRecord& rec)
+    {
+        rec.t = t;
+        rec.p = isect.p;
+        rec.u = isect.uv.x;
+        rec.v = isect.uv.y;
+        rec.material = material;
+
+        const auto& n = isect.shading.n;
+        rec.face_normal(r, Vec3{n.x, n.y, n.z});
+    }
+
+    /// @brief Shape in the scene
+    ///
+    /// Bridge between the shapes (see `Shapes::Shape`), which only
+    /// describe a surface, and the objects of the scene: gives the
+    /// shape a material, and its intersections a hit record.
+    class GeometricPrimitive: public Hittable
+    {
+        public:
+
+            GeometricPrimitive(const Ref<Shapes::Shape>& shape, const Ref<Material>& mat):
+                shape(shape), material(MaterialTable::add(mat)) {}
+
+            bool hit(const Ray& r, float tmin, float tmax, HitRecord& rec) const override
+            {
+                float t;
+                SurfaceInteraction isect;
+                if(!shape->hit(r, tmin, tmax, t, isect))
+                    return false;
+
+                shape_record(r, t, isect, material, rec);
+                return true;
+            }
+
+            bool occluded(const Ray& r, float tmin, float tmax) const override
+            {
+                return shape->occluded(r, tmin, tmax);
+            }
+
+            bool bounds(Bounds& box, float t0, float t1) const override
+            {
+                box = shape->worldspace_bounds();
+                return true;
+            }
+
+        public:
+
+            Ref<Shapes::Shape> shape;
+            uint32_t material;
+    };
+
+    /// @brief Group of shapes of the same type
+    ///
+    /// The shapes are stored by value in a single array, in the order
+    /// of the leaves of a BVH over them (see `build_ranges()`), rather
+    /// than each behind its own `Ref<Hittable>`: the group is a single
+    /// object of the scene, its shapes are next to each other in
+    /// memory, and since `S` is known (and final), their `hit()` is
+    /// called directly instead of virtually, and can be inlined in
+    /// the loop over a leaf, which the compiler is then free to
+    /// vectorize. All the shapes share the same material.
+    template<typename S> requires std::derived_from<S, Shapes::Shape>
+    class ShapeGroup: public Hittable
+    {
+        public:
+
+            ShapeGroup(std::vector<S> shapes, const Ref<Material>& mat):
+                material(MaterialTable::add(mat))
+            {
+                auto count = shapes.size();
+                std::vector<BVHprimitive> prims(count);
+
+                parallel_for(static_cast<uint32_t>(count), [&](uint32_t i)
+                {
+                    auto box = shapes[i].worldspace_bounds();
+                    prims[i] = {box, box.centroid(), i};
+                });
+
+                if(count == 0)
+                    return;
+
+                build_ranges(nodes, prims, 0, count, hardware_threads());
+
+                this->shapes.reserve(count);
+                for (const auto& prim: prims)
+                    this->shapes.push_back(shapes[prim.index]);
+            }
+
+            bool hit(const Ray& r, float tmin, float tmax, HitRecord& rec) const override
+            {
+                float t_hit;
+                SurfaceInteraction closest;
+
+                auto hit = traverse(nodes, r, tmin, tmax, [&](uint32_t first, uint32_t count, float& tmax)
+                {
+                    bool hit = false;
+                    for (auto i = first; i < first + count; ++i)
+                    {
+                        if(shapes[i].hit(r, tmin, tmax, t_hit, closest))
+                        {
+                            hit = true;
+                            tmax = t_hit;
+                        }
+                    }
+
+                    return hit;
+                });
+
+                if(hit)
+                    shape_record(r, t_hit, closest, material, rec);
+
+                return hit;
+            }
+
+            bool occluded(const Ray& r, float tmin, float tmax) const override
+            {
+                return traverse<true>(nodes, r, tmin, tmax, [&](uint32_t first, uint32_t count, float&)
+                {
+                    for (auto i = first; i < first + count; ++i)
+                    {
+                        if(shapes[i].occluded(r, tmin, tmax))
+                            return true;
+                    }
+
+                    return false;
+                });
+            }
+
+            bool bounds(Bounds& box, float t0, float t1) const override
+            {
+                if(nodes.empty())
+                    return false;
+
+                box = nodes[0].box;
+                return true;
+            }
+
+        public:
+
+            std::vector<S> shapes;
+            uint32_t material;
+
+        private:
+
+            std::vector<LinearBVHnode> nodes;
+    };
+}
\ No newline at end of file
@@ -1,7 +1,7 @@
 
 #include "Shape.hpp"
 
-namespace Ilya
+namespace Ilya::Shapes
 {
     Bounds Shape::worldspace_bounds() const
     {
@@ -18,4 +18,23 @@ namespace Ilya
         T_swaps_handedness(objtoworld->swaps_handedness())
     {
     }
+
+    SurfaceInteraction Shape::to_world(const SurfaceInteraction& isect) const
+    {
+        auto ret = (*objtoworld)(isect);
+
+        // The normal given by dp/du x dp/dv points outside
+        // of the shape by construction; it must be flipped
+        // if the user asked so, and also if the transform
+        // swaps the handedness of the coordinate system,
+        // since the cross product then changes direction
+        // (both cancel out).
+        if(reverse_orientation ^ T_swaps_handedness)
+        {
+            for (auto n: {&ret.element.n, &ret.shading.n})
+                *n = Normal{-n->x, -n->y, -n->z};
+        }
+
+        return ret;
+    }
 }
\ No newline at end of file
@@ -4,7 +4,7 @@
 #include "Core.hpp"
 #include "Utils/Transform.hpp"
 
-namespace Ilya
+namespace Ilya::Shapes
 {
     class Shape
     {
@@ -26,10 +26,30 @@ namespace Ilya
             /// handedness.
             Shape(const Ref<Transform>& objtoworld, bool reverse_orientation);
 
+            virtual ~Shape() = default;
+
             virtual Bounds objspace_bounds() const = 0;
             virtual Bounds worldspace_bounds() const;
 
-            virtual bool hit(const Ray& r, float& t, SurfaceInteraction& isect) const = 0;
+            /// Tells whether the ray `r` (in world space) hits
+            /// the shape between `tmin` and `tmax`; if so, puts
+            /// the distance to the hit in `t`, and the surface
+            /// at that point, in world space, in `isect`.
+            virtual bool hit(const Ray& r, float tmin, float tmax, float& t,
+                             SurfaceInteraction& isect) const = 0;
+
+            /// Tells whether the ray `r` (in world space) hits
+            /// the shape anywhere between `tmin` and `tmax`,
+            /// without computing the surface at that point (see
+            /// `Hittable::occluded()`). Defaults to `hit()`.
+            virtual bool occluded(const Ray& r, float tmin, float tmax) const
+            {
+                float t;
+                SurfaceInteraction isect;
+                return hit(r, tmin, tmax, t, isect);
+            }
+
+            /// Surface area of the shape, in object space.
             virtual float area() const = 0;
 
         public:
@@ -37,5 +57,12 @@ namespace Ilya
             const Ref<Transform> objtoworld, worldtoobj;
             const bool reverse_orientation;
             const bool T_swaps_handedness;
+
+        protected:
+
+            /// Bring the surface interaction `isect`, found in
+            /// object space, to world space, and flip its normals
+            /// if the orientation of the shape is reversed.
+            SurfaceInteraction to_world(const SurfaceInteraction& isect) const;
     };
 }
\ No newline at end of file
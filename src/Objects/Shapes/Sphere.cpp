@@ -1,9 +1,8 @@
 
 #include "Sphere.hpp"
 
-namespace Ilya
+namespace Ilya::Shapes
 {
-
     Sphere::Sphere(float radius, float zmin, float zmax, float phimax,
                    const Ref<Transform>& objtoworld, bool reverse_orientation):
             Shape(objtoworld, reverse_orientation), radius(radius)
@@ -11,15 +10,164 @@ namespace Ilya
         this->zmin = glm::clamp(glm::min(zmin, zmax), -radius, radius);
         this->zmax = glm::clamp(glm::max(zmin, zmax), -radius, radius);
 
-        thetaMin = glm::acos(zmin);
-        thetaMax = glm::acos(zmax);
+        thetaMin = glm::acos(glm::clamp(this->zmin/radius, -1.f, 1.f));
+        thetaMax = glm::acos(glm::clamp(this->zmax/radius, -1.f, 1.f));
 
         phiMax = glm::radians(glm::clamp(phimax, 0.f, 360.f));
+
+        full = this->zmin <= -radius && this->zmax >= radius && phimax >= 360.f;
     }
 
     Bounds Sphere::objspace_bounds() const
     {
-        return {{-radius, -radius, zmin},
-                {radius, radius, zmax}};
+        // A sphere cut down to a thin band (zmin = zmax at worst) would
+        // have a box of (nearly) zero width, which no ray hits: leave
+        // a little room around the cuts, as for `Rectangle`.
+        return {{-radius, -radius, zmin - 0.0001f},
+                {radius, radius, zmax + 0.0001f}};
+    }
+
+    float Sphere::area() const
+    {
+        return phiMax*radius*(zmax - zmin);
+    }
+
+    bool Sphere::inside(const Point3& p, float& phi) const
+    {
+        phi = std::atan2(p.y, p.x);
+        if(phi < 0.f)
+            phi += 2*pi;
+
+        if(full)
+            return true;
+
+        return !((zmin > -radius && p.z < zmin) || (zmax < radius && p.z > zmax)
+                 || phi > phiMax);
+    }
+
+    bool Sphere::intersect(const Ray& ray, float tmin, float tmax, float& t,
+                           Point3& p, float& phi) const
+    {
+        // The sphere is intersected in object space, where it is
+        // centered at the origin: the points o + td of the ray on the
+        // sphere are the roots of the quadratic a t^2 + 2b t + c, with
+        // a = d.d, b = o.d and c = o.o - r^2.
+        auto o = ray.orig - Point3{}, d = ray.dir;
+
+        auto a = dot(d, d);
+        auto b = dot(o, d);
+        auto c = dot(o, o) - radius*radius;
+
+        // The discriminant b^2 - ac loses all its precision when the
+        // sphere is small and far away, the two terms being then
+        // nearly equal; it is also a(r^2 - |o - (b/a)d|^2), where
+        // o - (b/a)d is the point of the ray closest to the center,
+        // which doesn't suffer from it.
+        auto l = o - (b/a)*d;
+        auto discriminant = a*(radius*radius - dot(l, l));
+        if(discriminant < 0.f)
+            return false;
+
+        // The usual formula (-b +- sqrt(disc))/a subtracts two nearly
+        // equal numbers for one of the roots; the other one is then
+        // computed from the product of the roots, c/a. q is only 0 for
+        // a ray grazing the sphere at its origin (both roots are 0),
+        // which the range excludes; c/q would be NaN.
+        auto q = -(b + std::copysign(std::sqrt(discriminant), b));
+        if(q == 0.f)
+            return false;
+
+        auto t0 = q/a, t1 = c/q;
+        if(t0 > t1)
+            std::swap(t0, t1);
+
+        if(t0 > tmax || t1 <= tmin)
+            return false;
+
+        // The closest root is tried first, then the farthest one if
+        // it is out of range or on a part of the sphere that was cut.
+        auto on_surface = [&](float root)
+        {
+            if(!(root > tmin && root <= tmax))
+                return false;
+
+            // The hit point is projected back on the sphere, since the
+            // computation of t introduces some error; at the poles, it
+            // is moved a little so that phi (and dp/du) is defined.
+            p = ray(root);
+            p = p*(radius/length(p - Point3{}));
+            if(p.x == 0.f && p.y == 0.f)
+                p.x = 1e-5f*radius;
+
+            return inside(p, phi);
+        };
+
+        t = t0;
+        if(!on_surface(t))
+        {
+            t = t1;
+            if(!on_surface(t))
+                return false;
+        }
+
+        return true;
+    }
+
+    bool Sphere::occluded(const Ray& r, float tmin, float tmax) const
+    {
+        float t, phi;
+        Point3 p;
+        return intersect((*worldtoobj)(r), tmin, tmax, t, p, phi);
+    }
+
+    bool Sphere::hit(const Ray& r, float tmin, float tmax, float& t,
+                     SurfaceInteraction& isect) const
+    {
+        auto ray = (*worldtoobj)(r);
+        float t_hit, phi;
+        Point3 p;
+        if(!intersect(ray, tmin, tmax, t_hit, p, phi))
+            return false;
+
+        // Parametric coordinates of the hit, and the partial
+        // derivatives of the position along them: around the z axis
+        // for u, and along the meridians for v.
+        auto u = phi/phiMax;
+        auto cos_theta = glm::clamp(p.z/radius, -1.f, 1.f);
+        auto theta = std::acos(cos_theta);
+        auto dtheta = thetaMax - thetaMin;
+        auto v = (theta - thetaMin)/dtheta;
+
+        auto z_radius = std::sqrt(p.x*p.x + p.y*p.y);
+        auto cos_phi = p.x/z_radius, sin_phi = p.y/z_radius;
+        auto sin_theta = std::sqrt(std::max(0.f, 1.f - cos_theta*cos_theta));
+
+        auto dpdu = Vec3{-phiMax*p.y, phiMax*p.x, 0.f};
+        auto dpdv = dtheta*Vec3{p.z*cos_phi, p.z*sin_phi, -radius*sin_theta};
+
+        // The derivatives of the normal follow from the second
+        // derivatives of the position, by the Weingarten equations:
+        // with the coefficients E, F, G of the first fundamental form
+        // and e, f, g of the second one,
+        //   dn/du = ((fF - eG) dp/du + (eF - fE) dp/dv)/(EG - F^2)
+        //   dn/dv = ((gF - fG) dp/du + (fF - gE) dp/dv)/(EG - F^2)
+        auto d2pduu = -phiMax*phiMax*Vec3{p.x, p.y, 0.f};
+        auto d2pduv = dtheta*p.z*phiMax*Vec3{-sin_phi, cos_phi, 0.f};
+        auto d2pdvv = -dtheta*dtheta*(p - Point3{});
+
+        auto E = dot(dpdu, dpdu), F = dot(dpdu, dpdv), G = dot(dpdv, dpdv);
+        auto n = normalize(cross(dpdu, dpdv));
+        auto e = dot(n, d2pduu), f = dot(n, d2pduv), g = dot(n, d2pdvv);
+
+        auto EGF2 = E*G - F*F;
+        auto inv_EGF2 = EGF2 == 0.f ? 0.f : 1.f/EGF2;
+        auto dndu = ((f*F - e*G)*inv_EGF2)*dpdu + ((e*F - f*E)*inv_EGF2)*dpdv;
+        auto dndv = ((g*F - f*G)*inv_EGF2)*dpdu + ((f*F - g*E)*inv_EGF2)*dpdv;
+
+        SurfaceElement element {dpdu, dpdv, Normal{dndu}, Normal{dndv}};
+        isect = to_world({p, -ray.dir, {u, v}, element, ray.cast_time});
+        t = t_hit;
+
+        return true;
     }
 }
\ No newline at end of file
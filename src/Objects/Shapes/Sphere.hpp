@@ -4,21 +4,57 @@
 #include "Shape.hpp"
 #include "Objects/Bounds.hpp"
 
-namespace Ilya
+namespace Ilya::Shapes
 {
-    class Sphere: public Shape
+    /// @brief Sphere centered at the origin of its object space
+    ///
+    /// The sphere can be partial: cut below `zmin` and above `zmax`
+    /// along the z axis, and swept only up to the angle `phiMax`
+    /// around it. The surface is parametrized by u = phi/phiMax and
+    /// v going from thetaMin (at `zmin`) to thetaMax (at `zmax`).
+    class Sphere final: public Shape
     {
         public:
 
+            /// Sphere of radius `radius`, between the heights `zmin`
+            /// and `zmax` and up to `phimax` degrees around z.
             Sphere(float radius, float zmin, float zmax, float phimax,
                    const Ref<Transform>& objtoworld, bool reverse_orientation);
 
+            /// Full sphere of radius `radius`.
+            Sphere(float radius, const Ref<Transform>& objtoworld,
+                   bool reverse_orientation = false):
+                Sphere(radius, -radius, radius, 360.f, objtoworld, reverse_orientation) {}
+
             Bounds objspace_bounds() const override;
 
+            bool hit(const Ray& r, float tmin, float tmax, float& t,
+                     SurfaceInteraction& isect) const override;
+            bool occluded(const Ray& r, float tmin, float tmax) const override;
+
+            float area() const override;
+
         public:
 
             const float radius;
             float zmin, zmax;
             float thetaMin, thetaMax, phiMax;
+
+        private:
+
+            /// Distance `t` and point `p` of the nearest intersection
+            /// of the ray `ray` (in object space) with the partial
+            /// sphere between `tmin` and `tmax`, if any, with the
+            /// angle of `p` around z in `phi`.
+            bool intersect(const Ray& ray, float tmin, float tmax, float& t,
+                           Point3& p, float& phi) const;
+
+            /// Is the point `p` of the whole sphere on the partial
+            /// one ? Puts its angle around z in `phi`.
+            bool inside(const Point3& p, float& phi) const;
+
+            /// Whether the sphere is whole, which saves the test
+            /// of the hit points against the cuts.
+            bool full;
     };
 }
\ No newline at end of file
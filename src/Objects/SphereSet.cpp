@@ -0,0 +1,213 @@
+
+#include "SphereSet.hpp"
+
+#include "Core/Parallel.hpp"
+
+#include <bit>
+
+namespace Ilya
+{
+    SphereSet::SphereSet(const std::vector<Point3>& centers, const std::vector<float>& radii,
+                         const std::vector<uint32_t>& materials)
+    {
+        auto count = centers.size();
+        if(radii.size() != count || materials.size() != count)
+            error("Sphere set centers, radii and materials don't match.\n");
+
+        count = std::min({count, radii.size(), materials.size()});
+        std::vector<BVHprimitive> prims(count);
+
+        parallel_for(static_cast<uint32_t>(count), [&](uint32_t i)
+        {
+            auto r = std::abs(radii[i]);
+            Bounds box {centers[i] - Vec3{r}, centers[i] + Vec3{r}};
+            prims[i] = {box, centers[i], i};
+        });
+
+        // Leaves hold up to one SIMD group of spheres, and are costed
+        // as such by the SAH; larger ranges are always split, even
+        // when their spheres have the same center (see
+        // `BVHnode::split()`).
+        if(count > 0)
+            build_ranges(nodes, prims, 0, count, hardware_threads(), width, width);
+
+        // The spheres are stored in the order of the leaves; the last
+        // leaf loads a full group past its first sphere, which reads
+        // the padding (and is masked out).
+        for (auto* v: {&x, &y, &z, &radius})
+            v->reserve(count + width);
+        this->materials.reserve(count + width);
+
+        for (const auto& prim: prims)
+        {
+            const auto& c = centers[prim.index];
+            x.push_back(c.x);
+            y.push_back(c.y);
+            z.push_back(c.z);
+            radius.push_back(radii[prim.index]);
+            this->materials.push_back(materials[prim.index]);
+        }
+
+        for (auto* v: {&x, &y, &z, &radius})
+            v->resize(count + width, 0.f);
+        this->materials.resize(count + width, 0);
+    }
+
+    using vf = vfloat<SphereSet::width>;
+
+    /// The ray in all the lanes of SIMD registers, along with the
+    /// factor a = d.d of the quadratic of the spheres (see
+    /// `Sphere::hit()`), which only depends on the ray: its inverse
+    /// is computed once, rather than dividing by it for each sphere.
+    struct RayLanes
+    {
+        explicit RayLanes(const Ray& r):
+            ox(r.orig.x), oy(r.orig.y), oz(r.orig.z),
+            dx(r.dir.x), dy(r.dir.y), dz(r.dir.z),
+            inv_a(1.f/dot(r.dir, r.dir)), va(dot(r.dir, r.dir)) {}
+
+        vf ox, oy, oz, dx, dy, dz, inv_a, va;
+    };
+
+    /// Mask of the spheres [i, i + lanes[ of `set` that the ray hits
+    /// between `tmin` and `tmax`, with the nearest root in that range
+    /// of each of them in `t`.
+    static uint32_t hit_group(const SphereSet& set, const RayLanes& ray, uint32_t i,
+                              uint32_t lanes, float tmin, float tmax, vf& t)
+    {
+        auto zero = vf{0.f};
+        auto valid = (1u << lanes) - 1u;
+
+        // With b = d.(o - c) (half of the usual one) and c =
+        // |o - c|^2 - r^2, the roots are (-b -+ sqrt(b^2 - ac))/a.
+        // The discriminant is computed as a(r^2 - |l|^2), with
+        // l = (o - c) - (b/a)d the point of the ray closest to
+        // the center (see `Shapes::Sphere::hit()`), since b^2
+        // and ac are nearly equal for small spheres far away.
+        auto ocx = ray.ox - vf::load(&set.x[i]);
+        auto ocy = ray.oy - vf::load(&set.y[i]);
+        auto ocz = ray.oz - vf::load(&set.z[i]);
+        auto rad = vf::load(&set.radius[i]);
+
+        auto b = ray.dx*ocx + ray.dy*ocy + ray.dz*ocz;
+        auto f = b*ray.inv_a;
+        auto lx = ocx - f*ray.dx, ly = ocy - f*ray.dy, lz = ocz - f*ray.dz;
+        auto discriminant = ray.va*(rad*rad - (lx*lx + ly*ly + lz*lz));
+
+        valid &= zero <= discriminant;
+        if(!valid)
+            return 0;
+
+        auto sqrtd = vsqrt(vmax(discriminant, zero));
+        auto vtmin = vf{tmin}, vtmax = vf{tmax};
+        auto t0 = (zero - b - sqrtd)*ray.inv_a;
+        auto t1 = (sqrtd - b)*ray.inv_a;
+
+        // As for `Sphere`, the nearest root in [tmin, tmax] is
+        // kept, if any.
+        auto in0 = (vtmin <= t0) & (t0 <= vtmax);
+        auto in1 = (vtmin <= t1) & (t1 <= vtmax);
+        t = select(in0, t0, t1);
+
+        return valid & (in0 | in1);
+    }
+
+    bool SphereSet::hit(const Ray& r, float tmin, float tmax, HitRecord& rec) const
+    {
+        RayLanes ray {r};
+        uint32_t closest = 0;
+        float t_hit = tmax;
+
+        // Each leaf is a single SIMD group.
+        auto hit = traverse(nodes, r, tmin, tmax, [&](uint32_t first, uint32_t count, float& tmax)
+        {
+            vf t;
+            auto valid = hit_group(*this, ray, first, count, tmin, tmax, t);
+            if(!valid)
+                return false;
+
+            alignas(64) float ts[width];
+            t.store(ts);
+
+            bool hit = false;
+            for (; valid; valid &= valid - 1)
+            {
+                auto lane = static_cast<uint32_t>(std::countr_zero(valid));
+                if(ts[lane] <= tmax)
+                {
+                    hit = true;
+                    tmax = t_hit = ts[lane];
+                    closest = first + lane;
+                }
+            }
+
+            return hit;
+        });
+
+        if(!hit)
+            return false;
+
+        // The rest of the record is only filled for the closest
+        // sphere.
+        Point3 center {x[closest], y[closest], z[closest]};
+        auto rad = radius[closest];
+
+        rec.t = t_hit;
+        rec.p = r(t_hit);
+        rec.material = materials[closest];
+
+        auto out_normal = (rec.p - center)/rad;
+        rec.face_normal(r, out_normal);
+        std::tie(rec.u, rec.v) = Sphere::sphere_uv(out_normal);
+
+        return true;
+    }
+
+    bool SphereSet::occluded(const Ray& r, float tmin, float tmax) const
+    {
+        RayLanes ray {r};
+
+        return traverse<true>(nodes, r, tmin, tmax, [&](uint32_t first, uint32_t count, float&)
+        {
+            vf t;
+            return hit_group(*this, ray, first, count, tmin, tmax, t) != 0;
+        });
+    }
+
+    bool SphereSet::bounds(Bounds& box, float t0, float t1) const
+    {
+        if(nodes.empty())
+            return false;
+
+        box = nodes[0].box;
+        return true;
+    }
+
+    void gather_spheres(HittableList& list, size_t min_count)
+    {
+        std::vector<Point3> centers;
+        std::vector<float> radii;
+        std::vector<uint32_t> materials;
+        std::vector<Ref<Hittable>> others;
+
+        for (const auto& obj: list.objects)
+        {
+            auto sphere = dynamic_cast<const Sphere*>(obj.get());
+            if(sphere && sphere->c0[0] == sphere->c1[0] && sphere->c0[1] == sphere->c1[1]
+                      && sphere->c0[2] == sphere->c1[2])
+            {
+                centers.push_back(sphere->c0);
+                radii.push_back(sphere->radius);
+                materials.push_back(sphere->material);
+            }
+            else
+                others.push_back(obj);
+        }
+
+        if(centers.empty() || centers.size() < min_count)
+            return;
+
+        others.push_back(std::make_shared<SphereSet>(centers, radii, materials));
+        list.objects = std::move(others);
+    }
+}
\ No newline at end of file
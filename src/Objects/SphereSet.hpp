@@ -0,0 +1,68 @@
+
+#pragma once
+
+#include "BVH.hpp"
+#include "Utils/Math/simd.hpp"
+
+namespace Ilya
+{
+    /// @brief Set of static spheres intersected several at a time
+    ///
+    /// The centers, radii and materials of the spheres are stored in
+    /// separate arrays (structure of arrays), in the order of the
+    /// leaves of a BVH over them (see `build_ranges()`), whose leaves
+    /// hold up to `width` spheres: a leaf loads the coordinates of all
+    /// its spheres in SIMD registers and tests them against the ray at
+    /// once, with AVX-512 (16 spheres) or AVX (8 spheres). The whole
+    /// set is a single object of the scene, and a sphere costs 20
+    /// bytes and its share of the nodes, instead of a heap-allocated
+    /// `Sphere`. Spheres of the set don't move.
+    class SphereSet: public Hittable
+    {
+        public:
+
+#if defined(__AVX512F__)
+            static constexpr int width = 16;
+#else
+            static constexpr int width = 8;
+#endif
+
+            /// Spheres of centers `centers` and radii `radii`, with
+            /// the materials of indices `materials` in the
+            /// `MaterialTable`.
+            SphereSet(const std::vector<Point3>& centers, const std::vector<float>& radii,
+                      const std::vector<uint32_t>& materials);
+
+            /// Spheres of centers `centers` and radii `radii`, all with
+            /// the material `mat`.
+            SphereSet(const std::vector<Point3>& centers, const std::vector<float>& radii,
+                      const Ref<Material>& mat):
+                SphereSet(centers, radii, std::vector<uint32_t>(centers.size(), MaterialTable::add(mat))) {}
+
+            bool hit(const Ray& r, float tmin, float tmax, HitRecord& rec) const override;
+            bool occluded(const Ray& r, float tmin, float tmax) const override;
+            bool bounds(Bounds& box, float t0, float t1) const override;
+
+            size_t size() const { return radius.size() - width; }
+
+        public:
+
+            /// Coordinates of the centers, radii and material indices,
+            /// followed by `width` unused entries, so that the loads
+            /// of the last leaf stay in the arrays.
+            std::vector<float> x, y, z, radius;
+            std::vector<uint32_t> materials;
+
+        private:
+
+            std::vector<LinearBVHnode> nodes;
+    };
+
+    /// @brief Gather the static spheres of a list in a `SphereSet`
+    ///
+    /// Scene compile pass: the `Sphere` objects of `list` that don't
+    /// move are removed from it and replaced by a single `SphereSet`
+    /// (if there are at least `min_count` of them). Nested lists are
+    /// left as they are.
+    void gather_spheres(HittableList& list, size_t min_count = SphereSet::width);
+}
\ No newline at end of file
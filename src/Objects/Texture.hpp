@@ -16,7 +16,7 @@ namespace Ilya
     };
 
     /// Solid (uniform) color texture
-    class SolidColor: public Texture
+    class SolidColor final: public Texture
     {
         public:
 
@@ -35,7 +35,7 @@ namespace Ilya
     };
 
     /// Checker texture of two subtextures
-    class CheckerTexture: public Texture
+    class CheckerTexture final: public Texture
     {
         public:
 
@@ -47,21 +47,26 @@ namespace Ilya
 
             Color val(float u, float v, const Point3& p) const override
             {
-                auto sines = std::sin(10*p.x)*std::sin(10*p.y)*std::sin(10*p.z);
-
-                if(sines > 0.f)
+                if(even_cell(p))
                     return even->val(u, v, p);
                 else
                     return odd->val(u, v, p);
             }
 
+            /// Does `p` fall on an even cell of the checker ?
+            static bool even_cell(const Point3& p)
+            {
+                auto sines = std::sin(10*p.x)*std::sin(10*p.y)*std::sin(10*p.z);
+                return sines > 0.f;
+            }
+
         public:
 
             Ref<Texture> even, odd;
     };
 
     /// Perlin noise texture
-    class NoiseTexture: public Texture
+    class NoiseTexture final: public Texture
     {
         public:
 
@@ -79,7 +84,7 @@ namespace Ilya
     };
 
     /// Texture that is an image
-    class ImageTexture: public Texture
+    class ImageTexture final: public Texture
     {
         public:
 
@@ -0,0 +1,290 @@
+
+#include "TriangleMesh.hpp"
+
+#include "Core/Parallel.hpp"
+
+namespace Ilya
+{
+    /// Ray set up for the watertight triangle intersection of Woop,
+    /// Benthin and Wald ("Watertight Ray/Triangle Intersection", 2013):
+    /// the axes are permuted so that z is the one along which the ray
+    /// direction is the largest, and the shear (sx, sy, sz) maps the
+    /// ray to the +z axis. This only depends on the ray, and is done
+    /// once for all the triangles it is tested against.
+    struct WatertightRay
+    {
+        explicit WatertightRay(const Ray& r): orig(r.orig)
+        {
+            auto ax = std::abs(r.dir.x), ay = std::abs(r.dir.y), az = std::abs(r.dir.z);
+            kz = (ax > ay) ? (ax > az ? 0 : 2) : (ay > az ? 1 : 2);
+            kx = (kz + 1) % 3;
+            ky = (kx + 1) % 3;
+
+            // Swapping x and y when the ray goes towards -z keeps the
+            // winding of the triangles, and thus the sign of the edge
+            // functions, the same for every ray.
+            if(r.dir[kz] < 0.f)
+                std::swap(kx, ky);
+
+            sx = r.dir[kx]/r.dir[kz];
+            sy = r.dir[ky]/r.dir[kz];
+            sz = 1.f/r.dir[kz];
+        }
+
+        Point3 orig;
+        int kx, ky, kz;
+        float sx, sy, sz;
+    };
+
+    /// Intersect the ray `wr` with the triangle (p0, p1, p2) between
+    /// `tmin` and `tmax`; on a hit, put its distance in `t` and its
+    /// barycentric coordinates in `b`.
+    static bool hit_triangle(const WatertightRay& wr, const Point3& p0, const Point3& p1,
+                             const Point3& p2, float tmin, float tmax, float& t, float b[3])
+    {
+        // Translate the vertices to the ray origin, then shear them so
+        // that the ray becomes the z axis: the triangle is hit if the
+        // origin is inside its projection on the xy plane.
+        auto a = p0 - wr.orig, c = p2 - wr.orig;
+        auto bb = p1 - wr.orig;
+        auto [kx, ky, kz] = std::array{wr.kx, wr.ky, wr.kz};
+
+        auto ax = a[kx] - wr.sx*a[kz], ay = a[ky] - wr.sy*a[kz];
+        auto bx = bb[kx] - wr.sx*bb[kz], by = bb[ky] - wr.sy*bb[kz];
+        auto cx = c[kx] - wr.sx*c[kz], cy = c[ky] - wr.sy*c[kz];
+
+        // The edge functions are twice the signed areas of the
+        // triangles formed by the origin and each edge: the origin is
+        // inside if they all have the same sign. When one of them is
+        // exactly 0, it is recomputed in double precision, so that a
+        // ray going exactly through an edge shared by two triangles
+        // still hits one of them: the mesh has no cracks.
+        auto u = cx*by - cy*bx;
+        auto v = ax*cy - ay*cx;
+        auto w = bx*ay - by*ax;
+
+        if(u == 0.f || v == 0.f || w == 0.f)
+        {
+            u = static_cast<float>(double(cx)*by - double(cy)*bx);
+            v = static_cast<float>(double(ax)*cy - double(ay)*cx);
+            w = static_cast<float>(double(bx)*ay - double(by)*ax);
+        }
+
+        if((u < 0.f || v < 0.f || w < 0.f) && (u > 0.f || v > 0.f || w > 0.f))
+            return false;
+
+        auto det = u + v + w;
+        if(det == 0.f)
+            return false;
+
+        // The distance is interpolated from the (scaled) z of the
+        // vertices, and compared to the range before dividing by the
+        // determinant.
+        auto az = wr.sz*a[kz], bz = wr.sz*bb[kz], cz = wr.sz*c[kz];
+        auto t_scaled = u*az + v*bz + w*cz;
+
+        if(det < 0.f ? (t_scaled >= tmin*det || t_scaled < tmax*det)
+                     : (t_scaled <= tmin*det || t_scaled > tmax*det))
+            return false;
+
+        auto inv_det = 1.f/det;
+        t = t_scaled*inv_det;
+        b[0] = u*inv_det;
+        b[1] = v*inv_det;
+        b[2] = w*inv_det;
+
+        return true;
+    }
+
+    TriangleMesh::TriangleMesh(std::vector<Point3> positions, std::vector<uint32_t> indices,
+                               const Ref<Material>& mat, std::vector<Vec3> normals,
+                               std::vector<Vec2> uvs):
+        positions(std::move(positions)), normals(std::move(normals)), uvs(std::move(uvs)),
+        indices(std::move(indices)), material(MaterialTable::add(mat))
+    {
+        // Bad buffers are reported and repaired rather than read out
+        // of bounds later: the incomplete last triangle and the ones
+        // with indices past the vertices are dropped, and attributes
+        // that don't match the vertices are ignored.
+        if(this->indices.size() % 3 != 0)
+        {
+            error("Index buffer of a triangle mesh is not made of triangles.\n");
+            this->indices.resize(this->indices.size() - this->indices.size() % 3);
+        }
+
+        auto vertices = this->positions.size();
+        size_t kept = 0;
+        for (size_t i = 0; i < this->indices.size(); i += 3)
+        {
+            auto* triangle = &this->indices[i];
+            if(triangle[0] < vertices && triangle[1] < vertices && triangle[2] < vertices)
+            {
+                std::copy_n(triangle, 3, &this->indices[kept]);
+                kept += 3;
+            }
+        }
+
+        if(kept != this->indices.size())
+        {
+            error("Triangle mesh indices are out of its vertices.\n");
+            this->indices.resize(kept);
+        }
+
+        if(!this->normals.empty() && this->normals.size() != vertices)
+        {
+            error("Triangle mesh normals don't match its vertices.\n");
+            this->normals.clear();
+        }
+
+        if(!this->uvs.empty() && this->uvs.size() != vertices)
+        {
+            error("Triangle mesh UVs don't match its vertices.\n");
+            this->uvs.clear();
+        }
+
+        // The BVH is built over the bounds of the triangles with the
+        // same SAH splits as the scene BVH (see `build_ranges()`),
+        // except that the leaves are ranges of the triangle array.
+        auto count = triangles();
+        std::vector<BVHprimitive> prims(count);
+
+        constexpr uint32_t block_size = 4096;
+        auto blocks = static_cast<uint32_t>((count + block_size - 1)/block_size);
+
+        parallel_for(blocks, [&](uint32_t block)
+        {
+            auto first = size_t(block)*block_size;
+            auto last = std::min(first + block_size, count);
+
+            for (auto i = first; i < last; ++i)
+            {
+                const auto& p0 = this->positions[this->indices[3*i]];
+                const auto& p1 = this->positions[this->indices[3*i + 1]];
+                const auto& p2 = this->positions[this->indices[3*i + 2]];
+
+                auto box = surrounding_box(surrounding_box(Bounds{p0}, p1), p2);
+                prims[i] = {box, box.centroid(), static_cast<uint32_t>(i)};
+            }
+        });
+
+        if(count == 0)
+            return;
+
+        build_ranges(nodes, prims, 0, count, hardware_threads());
+        nodes.shrink_to_fit();
+
+        // Reorder the triangles in the order of the leaves, so that
+        // each leaf is a contiguous range of the index buffer.
+        std::vector<uint32_t> sorted(this->indices.size());
+        for (size_t i = 0; i < count; ++i)
+            std::copy_n(&this->indices[3*prims[i].index], 3, &sorted[3*i]);
+
+        this->indices = std::move(sorted);
+    }
+
+    bool TriangleMesh::hit(const Ray& r, float tmin, float tmax, HitRecord& rec) const
+    {
+        // Only the distance and barycentric coordinates of the closest
+        // hit are kept during the traversal; the rest of the record is
+        // filled once at the end.
+        WatertightRay wr {r};
+        uint32_t closest = 0;
+        float t_hit, b[3];
+
+        auto hit = traverse(nodes, r, tmin, tmax, [&](uint32_t first, uint32_t count, float& tmax)
+        {
+            bool hit = false;
+            for (uint32_t i = first; i < first + count; ++i)
+            {
+                float t, bi[3];
+                if(hit_triangle(wr, positions[indices[3*i]], positions[indices[3*i + 1]],
+                                positions[indices[3*i + 2]], tmin, tmax, t, bi))
+                {
+                    hit = true;
+                    tmax = t_hit = t;
+                    closest = i;
+                    std::copy_n(bi, 3, b);
+                }
+            }
+
+            return hit;
+        });
+
+        if(!hit)
+            return false;
+
+        // The barycentric coordinates weight the vertices: the edge
+        // function u is opposite to p0, v to p1 and w to p2.
+        auto i0 = indices[3*closest], i1 = indices[3*closest + 1], i2 = indices[3*closest + 2];
+        const auto& p0 = positions[i0];
+        auto e1 = positions[i1] - p0, e2 = positions[i2] - p0;
+
+        rec.t = t_hit;
+        rec.p = p0 + b[1]*e1 + b[2]*e2;
+        rec.material = material;
+
+        // The geometric normal gives the side of the surface that was
+        // hit; interpolated normals, if any, only smooth the shading,
+        // and are flipped to that side.
+        auto normal = normalize(cross(e1, e2));
+        if(!normals.empty())
+        {
+            auto shading = normalize(b[0]*normals[i0] + b[1]*normals[i1] + b[2]*normals[i2]);
+            if(dot(shading, normal) < 0.f)
+                normal = -normal;
+
+            rec.face_normal(r, normal);
+            rec.normal = rec.frontFace ? shading : -shading;
+        }
+        else
+            rec.face_normal(r, normal);
+
+        if(!uvs.empty())
+        {
+            auto uv = b[0]*uvs[i0] + b[1]*uvs[i1] + b[2]*uvs[i2];
+            rec.u = uv.x;
+            rec.v = uv.y;
+        }
+        else
+        {
+            rec.u = b[1];
+            rec.v = b[2];
+        }
+
+        return true;
+    }
+
+    bool TriangleMesh::occluded(const Ray& r, float tmin, float tmax) const
+    {
+        WatertightRay wr {r};
+
+        return traverse<true>(nodes, r, tmin, tmax, [&](uint32_t first, uint32_t count, float&)
+        {
+            for (uint32_t i = first; i < first + count; ++i)
+            {
+                float t, b[3];
+                if(hit_triangle(wr, positions[indices[3*i]], positions[indices[3*i + 1]],
+                                positions[indices[3*i + 2]], tmin, tmax, t, b))
+                    return true;
+            }
+
+            return false;
+        });
+    }
+
+    bool TriangleMesh::bounds(Bounds& box, float t0, float t1) const
+    {
+        if(nodes.empty())
+            return false;
+
+        box = nodes[0].box;
+        return true;
+    }
+
+    size_t TriangleMesh::memory() const
+    {
+        return positions.size()*sizeof(Point3) + normals.size()*sizeof(Vec3)
+             + uvs.size()*sizeof(Vec2) + indices.size()*sizeof(uint32_t)
+             + nodes.size()*sizeof(LinearBVHnode);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+
+#pragma once
+
+#include "BVH.hpp"
+
+namespace Ilya
+{
+    /// @brief Mesh of triangles sharing indexed vertex buffers
+    ///
+    /// Vertex attributes are stored in one array each (positions, and
+    /// optionally normals and UVs, which are then given per vertex),
+    /// and each triangle is only three 32-bit indices into them, so
+    /// that a vertex shared by several triangles is stored once. The
+    /// mesh keeps its own BVH over its triangles, whose leaves are
+    /// ranges of the index buffer: the whole mesh is a single object
+    /// of the scene, and a triangle costs about 12 bytes of indices,
+    /// 16 bytes of BVH nodes and its share of the vertices, instead
+    /// of a heap-allocated `Hittable` of its own.
+    class TriangleMesh: public Hittable
+    {
+        public:
+
+            /// Mesh with the triangles given by `indices` (3 per
+            /// triangle) over the vertices `positions`, with per-vertex
+            /// `normals` and `uvs` if they are not empty. The index
+            /// buffer is reordered to follow the BVH.
+            TriangleMesh(std::vector<Point3> positions, std::vector<uint32_t> indices,
+                         const Ref<Material>& mat, std::vector<Vec3> normals = {},
+                         std::vector<Vec2> uvs = {});
+
+            bool hit(const Ray& r, float tmin, float tmax, HitRecord& rec) const override;
+            bool occluded(const Ray& r, float tmin, float tmax) const override;
+            bool bounds(Bounds& box, float t0, float t1) const override;
+
+            size_t triangles() const { return indices.size()/3; }
+
+            /// Size in bytes of the vertex, index and BVH buffers.
+            size_t memory() const;
+
+        public:
+
+            std::vector<Point3> positions;
+            std::vector<Vec3> normals;
+            std::vector<Vec2> uvs;
+            std::vector<uint32_t> indices;
+            uint32_t material;
+
+        private:
+
+            std::vector<LinearBVHnode> nodes;
+    };
+}
\ No newline at end of file
@@ -107,4 +107,9 @@ namespace Ilya
     {
         return color * (1/factor);
     }
+
+    float luminance(const Color& color)
+    {
+        return 0.2126f*color.r + 0.7152f*color.g + 0.0722f*color.b;
+    }
 }
\ No newline at end of file
@@ -54,4 +54,8 @@ namespace Ilya
     Color operator*(const Color& color, float factor);
     Color operator*(float factor, const Color& color);
     Color operator/(const Color& color, float factor);
+
+    /// Brightness of the color as perceived by the eye (the Y of the
+    /// CIE XYZ space, from linear sRGB components).
+    float luminance(const Color& color);
 }
\ No newline at end of file
@@ -9,6 +9,8 @@ namespace Ilya
     {
         public:
 
+            Interaction() = default;
+
             Interaction(const Point3& p, float time):
                 p(p), t(time), dir() {}
 
@@ -19,7 +21,7 @@ namespace Ilya
 
             Point3 p;
             Vec3 dir;
-            float t;
+            float t = 0.f;
     };
 
     struct SurfaceElement
@@ -34,6 +36,8 @@ namespace Ilya
         Normal dndu, dndv;
         Vec3 dpdu, dpdv;
 
+        SurfaceElement() = default;
+
         // The normal of the surface element is
         // calculated as the (normalized) cross
         // product of the dp/du and dp/dv vectors.
@@ -48,10 +52,12 @@ namespace Ilya
     {
         public:
 
+            SurfaceInteraction() = default;
+
             SurfaceInteraction(const Point3& p, const
                 Vec3& dir, const Point2& uv, const
                 SurfaceElement& element, float time):
-            Interaction(p, dir, time),
+            Interaction(p, dir, time), uv(uv),
             element(element), shading(element) {}
 
         public:
@@ -29,16 +29,6 @@ namespace Ilya
         return {p.x*inv, p.y*inv, p.z*inv};
     }
 
-    float& Point3::operator[](std::size_t idx)
-    {
-        return coords[idx];
-    }
-
-    float Point3::operator[](std::size_t idx) const
-    {
-        return coords[idx];
-    }
-
     Point3& Point3::operator+=(const Vec3& v)
     {
         x += v.x;
@@ -56,13 +46,13 @@ namespace Ilya
         // Then check if it is not equal to some axis, which we take here
         // to be X. We don't check exactly for the equality, to avoid
         // floating point rounding errors.
-        Vec3 a = (std::abs(w.x) > 0.9f) ? Vec3{0, 1, 0} : Vec3{1, 0, 0};
+        Vec3 a = (std::abs(this->w.x) > 0.9f) ? Vec3{0, 1, 0} : Vec3{1, 0, 0};
         // From those two vectors, build a third, perpendicular to both,
         // using the cross product:
-        v = normalize(cross(w, a));
+        v = normalize(cross(this->w, a));
         // Finally, with two unitary and orthogonal vectors in our basis,
         // we can easily find the third and last using the cross product
         // again:
-        u = cross(w, v);
+        u = cross(this->w, v);
     }
 }
\ No newline at end of file
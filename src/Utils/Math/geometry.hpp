@@ -5,10 +5,16 @@
 
 namespace Ilya
 {
+    using Vec2 = glm::vec2;
     using Vec3 = glm::vec3;
     using Vec4 = glm::vec4;
+    using Mat3 = glm::mat3;
     using Mat4 = glm::mat4;
 
+    /// 4 columns of 3 rows: the upper part of an affine 4x4 matrix,
+    /// whose last row is always (0, 0, 0, 1).
+    using Mat4x3 = glm::mat4x3;
+
     /// @brief 2D point class
     ///
     /// Points are zero-dimensional locations in
@@ -26,7 +32,7 @@ namespace Ilya
             };
 
             Point2(): x(0), y(0) {};
-            Point2(float x, float y, float z):
+            Point2(float x, float y):
                     x(x), y(y) {}
     };
 
@@ -56,8 +62,15 @@ namespace Ilya
             explicit Point3(const Vec3& v):
                 x(v.x), y(v.y), z(v.z) {}
 
-            float& operator[](std::size_t idx);
-            float operator[](std::size_t idx) const;
+            float& operator[](std::size_t idx)
+            {
+                return coords[idx];
+            }
+
+            float operator[](std::size_t idx) const
+            {
+                return coords[idx];
+            }
 
             Point3& operator+=(const Vec3& v);
     };
@@ -0,0 +1,199 @@
+
+#pragma once
+
+#include "ilpch.hpp"
+
+#if defined(__SSE4_1__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+namespace Ilya
+{
+    /// @brief Pack of N floats processed together
+    ///
+    /// The generic version is a plain array whose operations are
+    /// loops the compiler is free to vectorize; the 4-, 8- and 16-wide
+    /// versions are specialized with SSE, AVX and AVX-512 intrinsics
+    /// when the target supports them. Comparisons return a bitmask
+    /// with bit i set if the comparison is true for lane i.
+    template<int N>
+    struct vfloat
+    {
+        std::array<float, N> v;
+
+        vfloat() = default;
+        explicit vfloat(float x) { v.fill(x); }
+
+        static vfloat load(const float* p)
+        {
+            vfloat r;
+            std::copy(p, p + N, r.v.begin());
+            return r;
+        }
+
+        void store(float* p) const { std::copy(v.begin(), v.end(), p); }
+        float operator[](int i) const { return v[i]; }
+    };
+
+    template<int N>
+    inline vfloat<N> apply(const vfloat<N>& a, const vfloat<N>& b, auto op)
+    {
+        vfloat<N> r;
+        for (int i = 0; i < N; ++i)
+            r.v[i] = op(a.v[i], b.v[i]);
+        return r;
+    }
+
+    template<int N>
+    inline uint32_t compare(const vfloat<N>& a, const vfloat<N>& b, auto op)
+    {
+        uint32_t mask = 0;
+        for (int i = 0; i < N; ++i)
+            mask |= uint32_t(op(a.v[i], b.v[i])) << i;
+        return mask;
+    }
+
+    template<int N> inline vfloat<N> operator+(const vfloat<N>& a, const vfloat<N>& b) { return apply(a, b, std::plus<>{}); }
+    template<int N> inline vfloat<N> operator-(const vfloat<N>& a, const vfloat<N>& b) { return apply(a, b, std::minus<>{}); }
+    template<int N> inline vfloat<N> operator*(const vfloat<N>& a, const vfloat<N>& b) { return apply(a, b, std::multiplies<>{}); }
+    template<int N> inline vfloat<N> operator/(const vfloat<N>& a, const vfloat<N>& b) { return apply(a, b, std::divides<>{}); }
+    template<int N> inline vfloat<N> vmin(const vfloat<N>& a, const vfloat<N>& b) { return apply(a, b, [](float x, float y) { return y < x ? y : x; }); }
+    template<int N> inline vfloat<N> vmax(const vfloat<N>& a, const vfloat<N>& b) { return apply(a, b, [](float x, float y) { return y > x ? y : x; }); }
+    template<int N> inline uint32_t operator<(const vfloat<N>& a, const vfloat<N>& b) { return compare(a, b, std::less<>{}); }
+    template<int N> inline uint32_t operator<=(const vfloat<N>& a, const vfloat<N>& b) { return compare(a, b, std::less_equal<>{}); }
+
+    template<int N>
+    inline vfloat<N> vsqrt(const vfloat<N>& a)
+    {
+        vfloat<N> r;
+        for (int i = 0; i < N; ++i)
+            r.v[i] = std::sqrt(a.v[i]);
+        return r;
+    }
+
+    /// Lanes of `a` where `mask` is set, lanes of `b` elsewhere.
+    template<int N>
+    inline vfloat<N> select(uint32_t mask, const vfloat<N>& a, const vfloat<N>& b)
+    {
+        vfloat<N> r;
+        for (int i = 0; i < N; ++i)
+            r.v[i] = (mask >> i) & 1u ? a.v[i] : b.v[i];
+        return r;
+    }
+
+#if defined(__SSE4_1__)
+    template<>
+    struct vfloat<4>
+    {
+        __m128 v;
+
+        vfloat() = default;
+        vfloat(__m128 v): v(v) {}
+        explicit vfloat(float x): v(_mm_set1_ps(x)) {}
+
+        static vfloat load(const float* p) { return _mm_loadu_ps(p); }
+        void store(float* p) const { _mm_storeu_ps(p, v); }
+
+        float operator[](int i) const
+        {
+            alignas(16) float f[4];
+            _mm_store_ps(f, v);
+            return f[i];
+        }
+    };
+
+    inline vfloat<4> operator+(const vfloat<4>& a, const vfloat<4>& b) { return _mm_add_ps(a.v, b.v); }
+    inline vfloat<4> operator-(const vfloat<4>& a, const vfloat<4>& b) { return _mm_sub_ps(a.v, b.v); }
+    inline vfloat<4> operator*(const vfloat<4>& a, const vfloat<4>& b) { return _mm_mul_ps(a.v, b.v); }
+    inline vfloat<4> operator/(const vfloat<4>& a, const vfloat<4>& b) { return _mm_div_ps(a.v, b.v); }
+    inline vfloat<4> vmin(const vfloat<4>& a, const vfloat<4>& b) { return _mm_min_ps(b.v, a.v); }
+    inline vfloat<4> vmax(const vfloat<4>& a, const vfloat<4>& b) { return _mm_max_ps(b.v, a.v); }
+    inline vfloat<4> vsqrt(const vfloat<4>& a) { return _mm_sqrt_ps(a.v); }
+    inline uint32_t operator<(const vfloat<4>& a, const vfloat<4>& b) { return _mm_movemask_ps(_mm_cmplt_ps(a.v, b.v)); }
+    inline uint32_t operator<=(const vfloat<4>& a, const vfloat<4>& b) { return _mm_movemask_ps(_mm_cmple_ps(a.v, b.v)); }
+
+    inline vfloat<4> select(uint32_t mask, const vfloat<4>& a, const vfloat<4>& b)
+    {
+        auto bits = _mm_and_si128(_mm_set1_epi32(int(mask)), _mm_setr_epi32(1, 2, 4, 8));
+        auto m = _mm_castsi128_ps(_mm_cmpeq_epi32(bits, _mm_setzero_si128()));
+        return _mm_blendv_ps(a.v, b.v, m);
+    }
+#endif
+
+#if defined(__AVX__)
+    template<>
+    struct vfloat<8>
+    {
+        __m256 v;
+
+        vfloat() = default;
+        vfloat(__m256 v): v(v) {}
+        explicit vfloat(float x): v(_mm256_set1_ps(x)) {}
+
+        static vfloat load(const float* p) { return _mm256_loadu_ps(p); }
+        void store(float* p) const { _mm256_storeu_ps(p, v); }
+
+        float operator[](int i) const
+        {
+            alignas(32) float f[8];
+            _mm256_store_ps(f, v);
+            return f[i];
+        }
+    };
+
+    inline vfloat<8> operator+(const vfloat<8>& a, const vfloat<8>& b) { return _mm256_add_ps(a.v, b.v); }
+    inline vfloat<8> operator-(const vfloat<8>& a, const vfloat<8>& b) { return _mm256_sub_ps(a.v, b.v); }
+    inline vfloat<8> operator*(const vfloat<8>& a, const vfloat<8>& b) { return _mm256_mul_ps(a.v, b.v); }
+    inline vfloat<8> operator/(const vfloat<8>& a, const vfloat<8>& b) { return _mm256_div_ps(a.v, b.v); }
+    inline vfloat<8> vmin(const vfloat<8>& a, const vfloat<8>& b) { return _mm256_min_ps(b.v, a.v); }
+    inline vfloat<8> vmax(const vfloat<8>& a, const vfloat<8>& b) { return _mm256_max_ps(b.v, a.v); }
+    inline vfloat<8> vsqrt(const vfloat<8>& a) { return _mm256_sqrt_ps(a.v); }
+    inline uint32_t operator<(const vfloat<8>& a, const vfloat<8>& b) { return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)); }
+    inline uint32_t operator<=(const vfloat<8>& a, const vfloat<8>& b) { return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)); }
+
+    inline vfloat<8> select(uint32_t mask, const vfloat<8>& a, const vfloat<8>& b)
+    {
+        auto bits = _mm256_and_ps(_mm256_castsi256_ps(_mm256_set1_epi32(int(mask))),
+                                  _mm256_castsi256_ps(_mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128)));
+        auto m = _mm256_cmp_ps(bits, _mm256_setzero_ps(), _CMP_EQ_OQ);
+        return _mm256_blendv_ps(a.v, b.v, m);
+    }
+#endif
+
+#if defined(__AVX512F__)
+    template<>
+    struct vfloat<16>
+    {
+        __m512 v;
+
+        vfloat() = default;
+        vfloat(__m512 v): v(v) {}
+        explicit vfloat(float x): v(_mm512_set1_ps(x)) {}
+
+        static vfloat load(const float* p) { return _mm512_loadu_ps(p); }
+        void store(float* p) const { _mm512_storeu_ps(p, v); }
+
+        float operator[](int i) const
+        {
+            alignas(64) float f[16];
+            _mm512_store_ps(f, v);
+            return f[i];
+        }
+    };
+
+    inline vfloat<16> operator+(const vfloat<16>& a, const vfloat<16>& b) { return _mm512_add_ps(a.v, b.v); }
+    inline vfloat<16> operator-(const vfloat<16>& a, const vfloat<16>& b) { return _mm512_sub_ps(a.v, b.v); }
+    inline vfloat<16> operator*(const vfloat<16>& a, const vfloat<16>& b) { return _mm512_mul_ps(a.v, b.v); }
+    inline vfloat<16> operator/(const vfloat<16>& a, const vfloat<16>& b) { return _mm512_div_ps(a.v, b.v); }
+    inline vfloat<16> vmin(const vfloat<16>& a, const vfloat<16>& b) { return _mm512_min_ps(b.v, a.v); }
+    inline vfloat<16> vmax(const vfloat<16>& a, const vfloat<16>& b) { return _mm512_max_ps(b.v, a.v); }
+    inline vfloat<16> vsqrt(const vfloat<16>& a) { return _mm512_sqrt_ps(a.v); }
+    inline uint32_t operator<(const vfloat<16>& a, const vfloat<16>& b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ); }
+    inline uint32_t operator<=(const vfloat<16>& a, const vfloat<16>& b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ); }
+
+    inline vfloat<16> select(uint32_t mask, const vfloat<16>& a, const vfloat<16>& b)
+    {
+        return _mm512_mask_blend_ps(static_cast<__mmask16>(mask), b.v, a.v);
+    }
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,21 @@
+
+#include "PDF.hpp"
+#include "Objects/Hittable.hpp"
+
+namespace Ilya
+{
+    Vec3 HittablePDF::random_vector() const
+    {
+        // A random vector directed at a Hittable is a vector directed
+        // at a random point on the surface of the Hittable.
+        auto p = obj->random_point(origin);
+        return Vec3{p.x, p.y, p.z};
+    }
+
+    float HittablePDF::val(const Vec3& dir) const
+    {
+        // The probability that the ray {origin, dir} touches the
+        // Hittable object.
+        return obj->pdf_value({origin, dir});
+    }
+}
\ No newline at end of file
@@ -3,43 +3,51 @@
 
 #include "Core.hpp"
 #include "Random.hpp"
-#include "Objects/Hittable.hpp"
+
+#include <variant>
 
 namespace Ilya
 {
+    class Hittable;
+
     /// A PDF (Probability Density Function) is a probability
     /// distribution of points in space; that is, it is a function that
     /// gives the probability for a given vector to be randomly
-    /// generated. The PDF class does at the same time return this
+    /// generated. A PDF type does at the same time return this
     /// probability for any given vector, and work as a random vector
     /// generator following a distribution.
-    class PDF
+    ///
+    /// PDFs are small value types rather than a class hierarchy: a new
+    /// one is needed at each bounce of every path, and they are cheap
+    /// to create on the stack, whereas allocating them on the heap
+    /// would cost an allocation (and its atomic reference counting)
+    /// per bounce.
+    template<typename T>
+    concept PDF = requires(const T& pdf, const Vec3& dir)
     {
-        public:
+        /// Sends a random vector following the PDF distribution.
+        { pdf.random_vector() } -> std::convertible_to<Vec3>;
 
-            /// Sends a random vector following the PDF distribution.
-            virtual Vec3 random_vector() const = 0;
-
-            /// Gives the value of the PDF for the vector `dir`.
-            virtual float val(const Vec3& dir) const = 0;
+        /// Gives the value of the PDF for the vector `dir`.
+        { pdf.val(dir) } -> std::convertible_to<float>;
     };
 
     /// Cosine distribution PDF, used for example in Lambertian
     /// materials.
-    class CosinePDF: public PDF
+    class CosinePDF
     {
         public:
 
             explicit CosinePDF(const Vec3& w): uvw(w) {}
 
-            Vec3 random_vector() const override
+            Vec3 random_vector() const
             {
                 // Generate a random vector following a cosine
                 // distribution in the local basis:
                 return uvw.local(Random::cosine_dir());
             }
 
-            float val(const Vec3& dir) const override
+            float val(const Vec3& dir) const
             {
                 // If the cosine is nonpositive, that is, if the angle
                 // between the random vector and the surface normal is
@@ -57,65 +65,124 @@ namespace Ilya
             ONB uvw;
     };
 
+    /// Uniform distribution over all directions, used for example in
+    /// isotropic materials.
+    class SpherePDF
+    {
+        public:
+
+            Vec3 random_vector() const
+            {
+                return Random::unit_vector();
+            }
+
+            float val(const Vec3&) const
+            {
+                return 1.f/(4.f*pi);
+            }
+    };
+
     /// Hittable-oriented distribution, that is, the probability
     /// distribution of random vectors on the surface of a given
     /// hittable. This is useful for example to do importance sampling of
     /// a light object: the PDF will produce random vectors directed only
     /// towards the light, which reduces the noise coming from rays
-    /// bouncing around the box and never finding it.
-    class HittablePDF: public PDF
+    /// bouncing around the box and never finding it. The hittable is
+    /// only referenced, and must outlive the PDF.
+    class HittablePDF
     {
         public:
 
-            HittablePDF(const Ref<Hittable>& obj, const Point3& origin):
-                    obj(obj), origin(origin) {}
-
-            Vec3 random_vector() const override
-            {
-                // A random vector directed at a Hittable is a vector
-                // directed at a random point on the surface of the
-                // Hittable.
-                auto p = obj->random_point(origin);
-                return Vec3{p.x, p.y, p.z};
-            }
+            HittablePDF(const Hittable& obj, const Point3& origin):
+                    obj(&obj), origin(origin) {}
 
-            float val(const Vec3& dir) const override
-            {
-                // The probability that the ray {origin, dir} touches
-                // the Hittable object.
-                return obj->pdf_value({origin, dir});
-            }
+            Vec3 random_vector() const;
+            float val(const Vec3& dir) const;
 
         private:
 
-            Ref<Hittable> obj;
+            const Hittable* obj;
             Point3 origin;
     };
 
     /// Utility class for mixing different PDFs in order to control the
-    /// exact kind of importance sampling we want for the scene.
-    class MixturePDF: public PDF
+    /// exact kind of importance sampling we want for the scene. Both
+    /// PDFs are only referenced, and must outlive the mixture.
+    template<PDF P0, PDF P1>
+    class MixturePDF
     {
         public:
 
-            MixturePDF(const Ref<PDF>& p0, const Ref<PDF>& p1):
+            MixturePDF(const P0& p0, const P1& p1):
                     p0(p0), p1(p1) {}
 
-            Vec3 random_vector() const override
+            Vec3 random_vector() const
             {
                 if(Random::rfloat() < 0.5f)
-                    return p0->random_vector();
+                    return p0.random_vector();
                 else
-                    return p1->random_vector();
+                    return p1.random_vector();
             }
 
-            float val(const Vec3& dir) const override
+            float val(const Vec3& dir) const
             {
-                return 0.5f*(p0->val(dir) + p1->val(dir));
+                return 0.5f*(p0.val(dir) + p1.val(dir));
             }
 
         public:
 
-            Ref<PDF> p0, p1;
+            const P0& p0;
+            const P1& p1;
+    };
+
+    /// Weight of a sample drawn by a strategy of density `f`, which
+    /// another strategy would have drawn with the density `g`, when
+    /// both strategies are combined by multiple importance sampling
+    /// (see `Renderer::direct_light()`). This is the power heuristic
+    /// with an exponent of 2, which favours the strategy that is
+    /// best at that sample more than the ratio of their densities
+    /// does, and gives less noise in practice. The weights of a
+    /// sample for both strategies add up to 1.
+    inline float power_heuristic(float f, float g)
+    {
+        auto f2 = f*f;
+        if(std::isinf(f2))
+            return 1.f;
+
+        return f2/(f2 + g*g);
+    }
+
+    /// PDF of the directions scattered off a material (see
+    /// `ScatterRecord`): one of the material PDFs above, stored in
+    /// place.
+    class ScatterPDF
+    {
+        public:
+
+            ScatterPDF() = default;
+
+            template<PDF T>
+            ScatterPDF(const T& pdf): pdf(pdf) {}
+
+            Vec3 random_vector() const
+            {
+                return std::visit([](const auto& p) { return p.random_vector(); }, pdf);
+            }
+
+            float val(const Vec3& dir) const
+            {
+                return std::visit([&](const auto& p) { return p.val(dir); }, pdf);
+            }
+
+            /// Does the PDF scatter off a surface, rather than in every
+            /// direction like in a medium ?
+            bool surface() const
+            {
+                return !std::holds_alternative<SpherePDF>(pdf);
+            }
+
+        private:
+
+            std::variant<SpherePDF, CosinePDF> pdf;
     };
 }
\ No newline at end of file
@@ -3,6 +3,6 @@
 
 namespace Ilya
 {
-    std::mt19937 Random::engine;
-    std::uniform_int_distribution<std::mt19937::result_type> Random::distribution;
+    thread_local PCG32 Random::engine;
+    thread_local SampleStream Random::stream;
 }
\ No newline at end of file
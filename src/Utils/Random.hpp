@@ -4,29 +4,148 @@
 #include "Core.hpp"
 #include "Utils/Math/geometry.hpp"
 #include "Utils/Math/functions.hpp"
+#include "Utils/Sampler.hpp"
 
 namespace Ilya
 {
+    /// PCG32 random number generator (see https://www.pcg-random.org):
+    /// a 64-bit linear congruential generator whose state is scrambled
+    /// by a permutation to produce 32-bit outputs. It is small (two
+    /// words of state), fast, statistically much better than `rand()`,
+    /// and supports 2^63 independent streams selected at seed time,
+    /// which we use to give each pixel its own sequence of numbers.
+    class PCG32
+    {
+        public:
+
+            using result_type = uint32_t;
+
+            PCG32() = default;
+
+            PCG32(uint64_t stream, uint64_t offset)
+            {
+                seed(stream, offset);
+            }
+
+            void seed(uint64_t stream, uint64_t offset)
+            {
+                // The increment selects the stream and must be odd;
+                // the state is then advanced once before and after
+                // adding the offset, so that nearby offsets and streams
+                // still give unrelated sequences.
+                state = 0u;
+                inc = (stream << 1u) | 1u;
+                (*this)();
+                state += offset;
+                (*this)();
+            }
+
+            uint32_t operator()()
+            {
+                auto old = state;
+                state = old * multiplier + inc;
+
+                // Output permutation: xorshift the high bits down, then
+                // rotate the result by an amount given by the top 5 bits
+                // of the old state.
+                auto xorshifted = static_cast<uint32_t>(((old >> 18u) ^ old) >> 27u);
+                auto rot = static_cast<uint32_t>(old >> 59u);
+
+                return (xorshifted >> rot) | (xorshifted << ((~rot + 1u) & 31u));
+            }
+
+            static constexpr uint32_t min() { return 0u; }
+            static constexpr uint32_t max() { return std::numeric_limits<uint32_t>::max(); }
+
+        private:
+
+            static constexpr uint64_t multiplier = 0x5851f42d4c957f2dULL;
+
+            uint64_t state = 0x853c49e6748fea9bULL;
+            uint64_t inc = 0xda3e39cb94b95bdbULL;
+    };
+
     class Random
     {
         public:
 
+            /// Random engine and sample stream of a thread (see
+            /// `save()`).
+            struct State
+            {
+                PCG32 engine;
+                SampleStream stream;
+            };
+
+            /// Reseed the random engine of the calling thread on the
+            /// given stream (the pixel index, for example) and offset
+            /// (the sample index). Every thread owns its own engine, so
+            /// that drawing numbers does not need any synchronization,
+            /// and seeding it explicitly makes the sequence of numbers
+            /// independent of which thread happens to do the work.
+            static void seed(uint64_t stream, uint64_t offset = 0u)
+            {
+                engine.seed(stream, offset);
+            }
+
+            /// Draw the numbers of the calling thread from the sample
+            /// `index` of the pixel (x, y) of `sampler`, one dimension
+            /// after the other, starting with the camera ones, rather
+            /// than from the random engine; a null `sampler` goes back
+            /// to the engine.
+            static void sample(const Sampler* sampler, uint32_t x = 0, uint32_t y = 0,
+                               uint32_t index = 0)
+            {
+                stream = {sampler, x, y, index};
+            }
+
+            /// Move to the dimensions of the bounce `bounce` of the
+            /// path (see `Sampler`); this does nothing without a
+            /// sampler.
+            static void bounce(uint32_t bounce)
+            {
+                stream.bounce(bounce);
+            }
+
+            /// State of the random engine of the calling thread, to be
+            /// restored later: this allows a thread to interleave
+            /// several independent sequences of numbers (the paths of
+            /// a wavefront, for example, see `Renderer`).
+            static State save()
+            {
+                return {engine, stream};
+            }
+
+            static void restore(const State& state)
+            {
+                engine = state.engine;
+                stream = state.stream;
+            }
+
             static uint32_t uint()
             {
-                return distribution(engine);
+                if(stream.sampler)
+                    return static_cast<uint32_t>(stream.next() * 0x1p32f);
+
+                return engine();
             }
 
+            /// Random integer in [min, max].
             static uint32_t uint(uint32_t min, uint32_t max)
             {
-//                return min + (distribution(engine) % (max - min + 1));
-                return static_cast<int>(rfloat(min, max));
+                // Multiply the 32-bit random number by the range size
+                // and keep the upper 32 bits of the result, which maps
+                // [0, 2^32[ onto [0, range[ without a division.
+                auto range = static_cast<uint64_t>(max - min) + 1u;
+                return min + static_cast<uint32_t>((uint() * range) >> 32u);
             }
 
             static float rfloat(float min = 0.f, float max = 1.f)
             {
-                //@todo: replace with an actual, fast PRNG
-//                float r = (float)distribution(engine) / (float)std::numeric_limits<uint32_t>::max();
-                float r = rand() / (RAND_MAX + 1.0);
+                // Keep the 24 upper bits, which fit exactly in a float
+                // mantissa, so that the result stays in [0, 1[.
+                float r = stream.sampler ? stream.next()
+                                         : static_cast<float>(engine() >> 8) * 0x1p-24f;
                 return r * (max - min) + min;
             }
 
@@ -40,19 +159,18 @@ namespace Ilya
                          rfloat(min, max)};
             }
 
-            /// Random vector that has unit length.
+            /// Random point inside the unit sphere.
             static Vec3 in_unit_sphere()
             {
-                while (true)
-                {
-                    // A random point inside a unit sphere is a random
-                    // vector in a unit cube which has norm less than 1.
-                    auto p = Random::vector(-1.f, 1.f);
-                    if (square(p) >= 1)
-                        continue;
-
-                    return p;
-                }
+                // A random point inside a unit sphere is a random
+                // direction, at a distance from the center whose
+                // cube is uniform (the volume of the ball of radius r
+                // grows as r^3). Rather than drawing points in the
+                // cube until one falls in the sphere, this always
+                // takes 3 numbers, which keeps the dimensions of the
+                // samples in step (see `Sampler`).
+                auto dir = unit_vector();
+                return std::cbrt(rfloat())*dir;
             }
 
             static Vec3 in_hemisphere(const Vec3& normal)
@@ -70,22 +188,50 @@ namespace Ilya
 
             static Vec3 in_unit_disk()
             {
-                // Create random vectors in the [-1, 1] square until the
-                // length is inferior to 1 (thus in the unit disk).
-                while(true)
-                {
-                    Vec3 p {rfloat(-1, 1), rfloat(-1, 1), 0.f};
-                    if(square(p) >= 1)
-                        continue;
+                auto u1 = rfloat();
+                auto u2 = rfloat();
+                return disk(u1, u2);
+            }
+
+            /// Point of the unit disk (in the z = 0 plane) for the
+            /// point (u1, u2) of the unit square. The concentric
+            /// mapping of Shirley and Chiu maps squares around the
+            /// center of the unit square to circles around the center
+            /// of the disk, so that samples well spread over the
+            /// square stay well spread over the disk, which rejecting
+            /// the points outside of it wouldn't do.
+            static Vec3 disk(float u1, float u2)
+            {
+                auto a = 2*u1 - 1.f, b = 2*u2 - 1.f;
+                if(a == 0.f && b == 0.f)
+                    return {};
 
-                    return p;
+                float r, theta;
+                if(std::abs(a) > std::abs(b))
+                {
+                    r = a;
+                    theta = pi/4*(b/a);
+                }
+                else
+                {
+                    r = b;
+                    theta = pi/2 - pi/4*(a/b);
                 }
+
+                return {r*std::cos(theta), r*std::sin(theta), 0.f};
             }
 
             /// Get a random unit vector.
             static Vec3 unit_vector()
             {
-                return normalize(in_unit_sphere());
+                // Uniform on the sphere: z is uniform in [-1, 1]
+                // (Archimedes' hat-box theorem), and so is the angle
+                // around it.
+                auto z = rfloat(-1.f, 1.f);
+                auto phi = rfloat(0.f, 2*pi);
+
+                auto s = std::sqrt(std::max(0.f, 1.f - z*z));
+                return {s*std::cos(phi), s*std::sin(phi), z};
             }
 
             static Vec3 cosine_dir()
@@ -123,7 +269,7 @@ namespace Ilya
 
         private:
 
-            static std::mt19937 engine;
-            static std::uniform_int_distribution<std::mt19937::result_type> distribution;
+            static thread_local PCG32 engine;
+            static thread_local SampleStream stream;
     };
 }
\ No newline at end of file
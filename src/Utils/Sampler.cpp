@@ -0,0 +1,334 @@
+
+#include "Sampler.hpp"
+
+#include <bit>
+
+namespace Ilya
+{
+    /// 32-bit integer hash with good avalanche (every input bit flips
+    /// each output bit with a probability close to 1/2), from Chris
+    /// Wellons' "hash prospector".
+    static uint32_t hash(uint32_t x)
+    {
+        x ^= x >> 16;
+        x *= 0x21f0aaadu;
+        x ^= x >> 15;
+        x *= 0x735a2d97u;
+        x ^= x >> 15;
+        return x;
+    }
+
+    static uint32_t hash(uint32_t a, uint32_t b)
+    {
+        return hash(a ^ (hash(b) + 0x9e3779b9u + (a << 6) + (a >> 2)));
+    }
+
+    template<typename... T>
+    static uint32_t hash(uint32_t a, uint32_t b, T... rest)
+    {
+        return hash(hash(a, b), rest...);
+    }
+
+    /// Float in [0, 1[ from the upper 24 bits of `bits`, which fit
+    /// exactly in a float mantissa (see `Random::rfloat()`).
+    static float to_unit(uint32_t bits)
+    {
+        return static_cast<float>(bits >> 8) * 0x1p-24f;
+    }
+
+    float IndependentSampler::get(uint32_t x, uint32_t y, uint32_t index, uint32_t dim) const
+    {
+        return to_unit(hash(x, y, index, dim, seed));
+    }
+
+    float SampleStream::next()
+    {
+        auto d = dim++;
+        if(d < end)
+            return sampler->get(x, y, index, d);
+
+        return to_unit(hash(x, y, index, d, sampler->seed ^ 0x68bc21ebu));
+    }
+
+    /// Element `i` of a random permutation of [0, l[ selected by `p`,
+    /// computed without storing the permutation (Kensler, "Correlated
+    /// Multi-Jittered Sampling", 2013): a hash that is a bijection on
+    /// the next power of two is applied until it falls in the range.
+    static uint32_t permute(uint32_t i, uint32_t l, uint32_t p)
+    {
+        auto w = std::bit_ceil(l) - 1u;
+
+        do
+        {
+            i ^= p; i *= 0xe170893du;
+            i ^= p >> 16; i ^= (i & w) >> 4;
+            i ^= p >> 8; i *= 0x0929eb3fu;
+            i ^= p >> 23; i ^= (i & w) >> 1;
+            i *= 1u | p >> 27; i *= 0x6935fa69u;
+            i ^= (i & w) >> 11; i *= 0x74dcb303u;
+            i ^= (i & w) >> 2; i *= 0x9e501cc3u;
+            i ^= (i & w) >> 2; i *= 0xc860a3dfu;
+            i &= w; i ^= i >> 5;
+        }
+        while(i >= l);
+
+        return (i + p) % l;
+    }
+
+    StratifiedSampler::StratifiedSampler(uint32_t samples, uint32_t seed):
+        Sampler(samples, seed)
+    {
+        grid = static_cast<uint32_t>(std::sqrt(float(samples)));
+        while(grid*grid > samples)
+            --grid;
+        while((grid + 1)*(grid + 1) <= samples)
+            ++grid;
+    }
+
+    float StratifiedSampler::get(uint32_t x, uint32_t y, uint32_t index, uint32_t dim) const
+    {
+        auto jitter = to_unit(hash(x, y, index, dim, seed));
+        if(index >= samples)
+            return jitter;
+
+        // Each pair of dimensions of each pixel shuffles the cells
+        // differently, so that the cell of a sample in one pair says
+        // nothing about its cell in the others.
+        auto pair = dim/2, axis = dim % 2;
+        auto cell = permute(index, samples, hash(x, y, pair, seed));
+
+        uint32_t stratum, strata;
+        if(grid*grid == samples)
+        {
+            stratum = axis ? cell/grid : cell % grid;
+            strata = grid;
+        }
+        else
+        {
+            stratum = axis ? permute(index, samples, hash(x, y, pair, seed + 1u)) : cell;
+            strata = samples;
+        }
+
+        return std::min((stratum + jitter)/strata, 1.f - 0x1p-24f);
+    }
+
+    /// The first primes, one base per dimension of the Halton sequence.
+    static constexpr auto halton_primes = []
+    {
+        std::array<uint32_t, HaltonSampler::primes> primes {};
+        uint32_t n = 0;
+        for (uint32_t k = 2; n < primes.size(); ++k)
+        {
+            bool prime = true;
+            for (uint32_t i = 0; i < n && primes[i]*primes[i] <= k; ++i)
+                prime = prime && k % primes[i] != 0;
+
+            if(prime)
+                primes[n++] = k;
+        }
+
+        return primes;
+    }();
+
+    /// Digits of `a` in base `base` mirrored around the decimal point
+    /// (0.d0 d1 d2... for a = ...d2 d1 d0), each digit being randomly
+    /// permuted depending on `seed` and the digits before it (Owen
+    /// scrambling). Digits are produced until they are below the
+    /// float precision, since the leading zeros of `a` are permuted
+    /// too.
+    static float scrambled_radical_inverse(uint32_t base, uint32_t a, uint32_t seed)
+    {
+        uint64_t reversed = 0;
+        double inv_base_n = 1.;
+        auto inv_base = 1./base;
+
+        while(inv_base_n > 0x1p-24)
+        {
+            auto next = a/base;
+            auto digit = permute(a - next*base, base, hash(seed, static_cast<uint32_t>(reversed)));
+            reversed = reversed*base + digit;
+            inv_base_n *= inv_base;
+            a = next;
+        }
+
+        return std::min(static_cast<float>(reversed*inv_base_n), 1.f - 0x1p-24f);
+    }
+
+    float HaltonSampler::get(uint32_t x, uint32_t y, uint32_t index, uint32_t dim) const
+    {
+        if(dim >= primes)
+            return to_unit(hash(x, y, index, dim, seed));
+
+        return scrambled_radical_inverse(halton_primes[dim], index, hash(x, y, dim, seed));
+    }
+
+    /// Generator matrices of the first 4 dimensions of the Sobol
+    /// sequence, one 32-bit column per bit of the index (see Bratley
+    /// and Fox, "Algorithm 659", 1988). The first dimension is the van
+    /// der Corput sequence; the others come from the primitive
+    /// polynomials x + 1, x^2 + x + 1 and x^3 + x + 1, with the initial
+    /// direction numbers of Joe and Kuo.
+    static constexpr auto sobol_matrices = []
+    {
+        std::array<std::array<uint32_t, 32>, 4> v {};
+
+        struct Polynomial { uint32_t degree, a; std::array<uint32_t, 3> m; };
+        constexpr Polynomial polynomials[3] {{1, 0, {1}}, {2, 1, {1, 3}}, {3, 1, {1, 3, 1}}};
+
+        for (uint32_t i = 0; i < 32; ++i)
+            v[0][i] = 1u << (31 - i);
+
+        for (uint32_t d = 1; d < 4; ++d)
+        {
+            const auto& [s, a, m] = polynomials[d - 1];
+            for (uint32_t i = 0; i < 32; ++i)
+            {
+                if(i < s)
+                {
+                    v[d][i] = m[i] << (31 - i);
+                    continue;
+                }
+
+                v[d][i] = v[d][i - s] ^ (v[d][i - s] >> s);
+                for (uint32_t k = 1; k < s; ++k)
+                    v[d][i] ^= ((a >> (s - 1 - k)) & 1u)*v[d][i - k];
+            }
+        }
+
+        return v;
+    }();
+
+    static uint32_t sobol(uint32_t index, uint32_t dim)
+    {
+        uint32_t x = 0;
+        for (uint32_t i = 0; index; index >>= 1, ++i)
+        {
+            if(index & 1u)
+                x ^= sobol_matrices[dim][i];
+        }
+
+        return x;
+    }
+
+    static uint32_t reverse_bits(uint32_t x)
+    {
+        x = (x << 16) | (x >> 16);
+        x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+        x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+        x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+        x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+        return x;
+    }
+
+    /// Owen scrambling of the bits of `x` selected by `seed`: the bits
+    /// are reversed so that the Laine-Karras hash, in which each bit
+    /// only depends on the lower ones, makes each bit depend on the
+    /// higher ones, which is what a nested uniform scramble is (see
+    /// Burley, 2020).
+    static uint32_t owen_scramble(uint32_t x, uint32_t seed)
+    {
+        x = reverse_bits(x);
+        x ^= x*0x3d20adeau;
+        x += seed;
+        x *= (seed >> 16) | 1u;
+        x ^= x*0x05526c56u;
+        x ^= x*0x53a22864u;
+        return reverse_bits(x);
+    }
+
+    float SobolSampler::get(uint32_t x, uint32_t y, uint32_t index, uint32_t dim) const
+    {
+        // Dimensions are taken by groups of 4, each one shuffling the
+        // order of the samples with its own seed: the samples of a
+        // pixel are still a Sobol sequence in each group, but are not
+        // correlated between groups. Scrambling the index keeps it in
+        // the same power-of-two block, so that the first 2^k samples
+        // stay well stratified.
+        auto group = hash(x, y, dim/4, seed);
+        auto shuffled = owen_scramble(index, group);
+
+        return to_unit(owen_scramble(sobol(shuffled, dim % 4), hash(group, dim % 4)));
+    }
+
+    ZSobolSampler::ZSobolSampler(uint32_t samples, uint32_t width, uint32_t height, uint32_t seed):
+        Sampler(samples, seed)
+    {
+        log2_samples = static_cast<uint32_t>(std::bit_width(std::bit_ceil(std::max(samples, 1u)) - 1u));
+        auto log2_resolution = static_cast<uint32_t>(std::bit_width(std::bit_ceil(std::max({width, height, 1u})) - 1u));
+
+        // Number of base-4 digits of the indices: one per level of the
+        // Z curve, plus the sample index (with half a digit left over
+        // for odd powers of two).
+        digits = log2_resolution + (log2_samples + 1)/2;
+        if(2*log2_resolution + log2_samples > 32)
+            error("Image too large for the blue noise sampler at {} samples per pixel.\n", samples);
+    }
+
+    /// Interleave the bits of x and y: the index of (x, y) along a Z
+    /// (Morton) curve.
+    static uint32_t morton(uint32_t x, uint32_t y)
+    {
+        auto spread = [](uint32_t v)
+        {
+            v &= 0x0000ffffu;
+            v = (v | (v << 8)) & 0x00ff00ffu;
+            v = (v | (v << 4)) & 0x0f0f0f0fu;
+            v = (v | (v << 2)) & 0x33333333u;
+            v = (v | (v << 1)) & 0x55555555u;
+            return v;
+        };
+
+        return spread(x) | (spread(y) << 1);
+    }
+
+    /// The 24 permutations of (0, 1, 2, 3).
+    static constexpr auto permutations = []
+    {
+        std::array<std::array<uint8_t, 4>, 24> perms {};
+        std::array<uint8_t, 4> p {0, 1, 2, 3};
+        for (auto& perm: perms)
+        {
+            perm = p;
+            std::next_permutation(p.begin(), p.end());
+        }
+
+        return perms;
+    }();
+
+    uint32_t ZSobolSampler::sample_index(uint32_t x, uint32_t y, uint32_t index, uint32_t pair) const
+    {
+        auto z = (morton(x, y) << log2_samples) | index;
+
+        // Each base-4 digit of the Z order index (each quadrant of the
+        // curve) is permuted with a permutation that depends on the
+        // digits above it: the 4 children of a node of the curve are
+        // visited in a random order, but pixels stay in blocks of 4,
+        // 16, etc. that get consecutive sample indices.
+        uint32_t ret = 0;
+        bool odd = log2_samples & 1u;
+        auto last = odd ? 1 : 0;
+
+        for (auto i = int(digits) - 1; i >= last; --i)
+        {
+            auto shift = 2*i - (odd ? 1 : 0);
+            auto digit = (z >> shift) & 3u;
+            auto higher = shift + 2 < 32 ? z >> (shift + 2) : 0u;
+            auto perm = hash(higher ^ (0x55555555u*pair), seed) % 24;
+
+            ret |= uint32_t(permutations[perm][digit]) << shift;
+        }
+
+        if(odd)
+            ret |= (z & 1u) ^ (hash((z >> 1) ^ (0x55555555u*pair), seed) & 1u);
+
+        return ret;
+    }
+
+    float ZSobolSampler::get(uint32_t x, uint32_t y, uint32_t index, uint32_t dim) const
+    {
+        auto pair = dim/2, axis = dim % 2;
+        auto i = sample_index(x, y, index, pair);
+
+        return to_unit(owen_scramble(sobol(i, axis), hash(pair, axis, seed)));
+    }
+}
\ No newline at end of file
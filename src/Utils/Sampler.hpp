@@ -0,0 +1,184 @@
+
+#pragma once
+
+#include "Core.hpp"
+
+namespace Ilya
+{
+    /// @brief Sample values for the pixels of an image
+    ///
+    /// Rendering a pixel estimates an integral over many dimensions:
+    /// the position in the pixel, on the lens, the time, then for each
+    /// bounce of the path the direction it scatters in, the light it
+    /// samples, whether it survives the russian roulette... Each
+    /// sample of the pixel is a point in that space, and each random
+    /// number drawn along its path is one of its coordinates, or
+    /// "dimensions". Drawing them independently (like `Random` does by
+    /// default) lets samples clump together and leave holes, which is
+    /// the noise of the image; samplers spread the samples of a pixel
+    /// more evenly over each dimension, so that the image converges
+    /// faster.
+    ///
+    /// Samplers are stateless: the value of a dimension only depends
+    /// on the pixel, the sample index and the dimension, so that paths
+    /// can be traced in any order, on any thread (see `SampleStream`).
+    /// The first `camera_dims` dimensions go to the camera ray (pixel
+    /// position, lens position and time, rounded up to 8 so that the
+    /// bounces start on a pair and a group of 4 dimensions, see
+    /// `SobolSampler`), then each bounce gets `bounce_dims` of them.
+    class Sampler
+    {
+        public:
+
+            /// Sampler for `samples` samples per pixel, whose values
+            /// are decorrelated by `seed`.
+            explicit Sampler(uint32_t samples, uint32_t seed = 0):
+                samples(samples), seed(seed) {}
+
+            virtual ~Sampler() = default;
+
+            /// Value in [0, 1[ of the dimension `dim` of the sample
+            /// `index` of the pixel (x, y).
+            virtual float get(uint32_t x, uint32_t y, uint32_t index, uint32_t dim) const = 0;
+
+        public:
+
+            static constexpr uint32_t camera_dims = 8;
+            static constexpr uint32_t bounce_dims = 8;
+
+            uint32_t samples, seed;
+    };
+
+    /// Independent uniform values, hashed from the pixel, sample and
+    /// dimension: the reference the other samplers improve on.
+    class IndependentSampler final: public Sampler
+    {
+        public:
+
+            using Sampler::Sampler;
+
+            float get(uint32_t x, uint32_t y, uint32_t index, uint32_t dim) const override;
+    };
+
+    /// @brief Stratified (jittered) sampling
+    ///
+    /// Dimensions are taken by pairs, whose unit square is divided in
+    /// a grid of n x n cells (with n^2 the number of samples), and
+    /// each sample of the pixel is put at a random place in its own
+    /// cell; the cells are given to the samples in a different random
+    /// order for each pair of dimensions. When the number of samples
+    /// is not a square, each dimension is divided in as many strata as
+    /// there are samples instead (latin hypercube sampling).
+    class StratifiedSampler final: public Sampler
+    {
+        public:
+
+            StratifiedSampler(uint32_t samples, uint32_t seed = 0);
+
+            float get(uint32_t x, uint32_t y, uint32_t index, uint32_t dim) const override;
+
+        private:
+
+            uint32_t grid;
+    };
+
+    /// @brief Halton sequence
+    ///
+    /// The dimension d of the sample i is the radical inverse of i in
+    /// the d-th prime base (its digits mirrored around the decimal
+    /// point), which fills each dimension ever more finely as i grows,
+    /// whatever the number of samples. In large bases, the first
+    /// samples only cover the start of [0, 1[ though, and dimensions
+    /// are correlated with each other: the digits are scrambled, with
+    /// a different random permutation for each pixel, dimension, and
+    /// the digits that precede them, which keeps the stratification.
+    /// Dimensions past the first `primes` are independent.
+    class HaltonSampler final: public Sampler
+    {
+        public:
+
+            using Sampler::Sampler;
+
+            float get(uint32_t x, uint32_t y, uint32_t index, uint32_t dim) const override;
+
+            static constexpr uint32_t primes = 64;
+    };
+
+    /// @brief Owen-scrambled Sobol sequence
+    ///
+    /// Sobol points in base 2 are stratified in every power-of-two
+    /// grid of each pair of their first dimensions: the first 2^k
+    /// samples leave no cell of any 2^a x 2^b grid (a + b = k) empty.
+    /// The sequence is randomized by Owen scrambling, which randomly
+    /// swaps the two halves of each binary interval, recursively: the
+    /// stratification is kept, and the error decreases even faster
+    /// for smooth integrands. Following Burley ("Practical Hash-based
+    /// Owen Scrambling", 2020), the scrambling is done with a hash
+    /// instead of tables, only the first 4 Sobol dimensions are used,
+    /// and further dimensions are padded with groups of 4 whose sample
+    /// order is shuffled independently.
+    class SobolSampler final: public Sampler
+    {
+        public:
+
+            using Sampler::Sampler;
+
+            float get(uint32_t x, uint32_t y, uint32_t index, uint32_t dim) const override;
+    };
+
+    /// @brief Blue noise from a screen-space Sobol sequence
+    ///
+    /// Instead of a sequence per pixel, the samples of the whole image
+    /// are taken from a single Owen-scrambled 2D Sobol sequence, where
+    /// pixels are ordered along a Z curve and the samples of a pixel
+    /// are consecutive (see Ahmed and Wonka, "Screen-Space Blue-Noise
+    /// Diffusion of Monte Carlo Sampling Error via Hierarchical
+    /// Ordering of Pixels", 2020). Neighbouring pixels then get well
+    /// stratified samples relative to each other too: the error is
+    /// still there, but as blue noise (without low frequencies), which
+    /// looks much less noisy at the same sample count. The base-4
+    /// digits of the indices are randomly permuted for each pair of
+    /// dimensions, as done in pbrt-v4. The Z order index must fit in
+    /// 32 bits: the image size (rounded up to a square power of two)
+    /// times the samples per pixel (rounded up to a power of two) is
+    /// at most 2^32.
+    class ZSobolSampler final: public Sampler
+    {
+        public:
+
+            ZSobolSampler(uint32_t samples, uint32_t width, uint32_t height, uint32_t seed = 0);
+
+            float get(uint32_t x, uint32_t y, uint32_t index, uint32_t dim) const override;
+
+        private:
+
+            /// Index in the sequence of the sample `index` of the pixel
+            /// (x, y) for the pair of dimensions `pair`.
+            uint32_t sample_index(uint32_t x, uint32_t y, uint32_t index, uint32_t pair) const;
+
+            uint32_t log2_samples, digits;
+    };
+
+    /// @brief Dimensions of a sample, in the order they are drawn
+    ///
+    /// Where a path is in the dimensions of its sample: `Random` draws
+    /// its numbers from there when a sampler is set (see
+    /// `Random::sample()`). Dimensions past the ones of a bounce, which
+    /// only a few paths use (rejection loops, for example), are filled
+    /// with independent values.
+    struct SampleStream
+    {
+        const Sampler* sampler = nullptr;
+        uint32_t x = 0, y = 0, index = 0;
+        uint32_t dim = 0, end = Sampler::camera_dims;
+
+        float next();
+
+        /// Move to the dimensions of the bounce `bounce`.
+        void bounce(uint32_t bounce)
+        {
+            dim = Sampler::camera_dims + bounce*Sampler::bounce_dims;
+            end = dim + Sampler::bounce_dims;
+        }
+    };
+}
\ No newline at end of file
@@ -171,9 +171,11 @@ namespace Ilya
         // Since n^T.t = 0, S^T.M = Id, therefore S^T
         // = M^-1 and so S = (M^-1)^T: normals must be
         // transformed by the inverse transpose of the
-        // transformation matrix.
-        auto normal = Vec4{n.x, n.y, n.z, 0.f};
-        auto newn = transpose(inverse(transform)) * normal;
+        // transformation matrix. Only its upper-left 3x3
+        // part acts on directions, and since we already
+        // have the inverse, it is computed once and for
+        // all when the transform is created.
+        auto newn = normal_matrix * Vec3{n.x, n.y, n.z};
 
         return Normal{newn};
     }
@@ -183,30 +185,134 @@ namespace Ilya
         // The transformation of an object bounding box
         // is calculated by transforming each of the
         // former box corners and calculating the new
-        // box extension at each step.
-
-        const auto& T = *this;
-        const auto& min = b.min;
-        const auto& max = b.max;
-
-        Point3 corner0 = {b.min.x, b.min.y, b.min.z};
-        Point3 corner1 = {b.max.x, b.min.y, b.min.z};
-        Point3 corner2 = {b.min.x, b.max.y, b.min.z};
-        Point3 corner3 = {b.min.x, b.min.y, b.max.z};
-        Point3 corner4 = {b.min.x, b.max.y, b.max.z};
-        Point3 corner5 = {b.max.x, b.max.y, b.min.z};
-        Point3 corner6 = {b.max.x, b.min.y, b.max.z};
-        Point3 corner7 = {b.max.x, b.max.y, b.max.z};
-
-        Bounds ret {T(corner0)};
-        ret = surrounding_box(ret, {T(corner1)});
-        ret = surrounding_box(ret, {T(corner2)});
-        ret = surrounding_box(ret, {T(corner3)});
-        ret = surrounding_box(ret, {T(corner4)});
-        ret = surrounding_box(ret, {T(corner5)});
-        ret = surrounding_box(ret, {T(corner6)});
-        ret = surrounding_box(ret, {T(corner7)});
+        // box extension from them; the 8 corners are
+        // transformed at once by the batch version.
+        std::array<Point3, 8> corners;
+        for (int i = 0; i < 8; ++i)
+            corners[i] = {b[i & 1].x, b[(i >> 1) & 1].y, b[(i >> 2) & 1].z};
+
+        (*this)(corners, corners);
+
+        Bounds ret {corners[0]};
+        for (int i = 1; i < 8; ++i)
+            ret = surrounding_box(ret, corners[i]);
+
+        return ret;
+    }
+
+    Ray Transform::operator()(const Ray& r) const
+    {
+        // The direction is not normalized, so that the
+        // distance of a hit along the transformed ray
+        // is the same as along the original one.
+        return {(*this)(r.orig), (*this)(r.dir), r.cast_time};
+    }
+
+    /// Transform the normal `n` with `T` and normalize it.
+    static Normal unit_normal(const Transform& T, const Normal& n)
+    {
+        auto tn = T(n);
+        return Normal{normalize(Vec3{tn.x, tn.y, tn.z})};
+    }
+
+    SurfaceInteraction Transform::operator()(const SurfaceInteraction& si) const
+    {
+        // Positions, tangents and normals of the
+        // surface elements are transformed as such;
+        // the derivatives of the normals are vectors
+        // of the tangent plane, but change with the
+        // normals, like them.
+        SurfaceInteraction ret;
+        ret.p = (*this)(si.p);
+        ret.dir = normalize((*this)(si.dir));
+        ret.t = si.t;
+        ret.uv = si.uv;
+
+        for (auto [from, to]: {std::pair{&si.element, &ret.element},
+                               std::pair{&si.shading, &ret.shading}})
+        {
+            to->n = unit_normal(*this, from->n);
+            to->dpdu = (*this)(from->dpdu);
+            to->dpdv = (*this)(from->dpdv);
+            to->dndu = (*this)(from->dndu);
+            to->dndv = (*this)(from->dndv);
+        }
 
         return ret;
     }
+
+    /// Apply the matrix `m` to the elements of `in`,
+    /// as points (with w = 1) or directions (w = 0),
+    /// and put the results in `out`. The elements are
+    /// processed by groups of N: their coordinates are
+    /// gathered lane by lane in SIMD registers, where
+    /// each row of the matrix is applied to all of them
+    /// at once, and scattered back. Points are divided
+    /// by their w coordinate only if `m` is not affine.
+    template<typename In, typename Out>
+    static void transform_batch(const Mat4& m, std::span<const In> in,
+                                std::span<Out> out, float w)
+    {
+        constexpr int N = 8;
+        using vf = vfloat<N>;
+
+        bool project = w != 0.f && (m[0][3] != 0.f || m[1][3] != 0.f ||
+                                    m[2][3] != 0.f || m[3][3] != 1.f);
+
+        vf col[4][4];
+        for (int i = 0; i < 4; ++i)
+        {
+            for (int j = 0; j < 4; ++j)
+                col[i][j] = vf{i == 3 ? m[i][j]*w : m[i][j]};
+        }
+
+        auto count = std::min(in.size(), out.size());
+        for (size_t first = 0; first < count; first += N)
+        {
+            auto n = static_cast<int>(std::min<size_t>(N, count - first));
+
+            alignas(64) float c[3][N] {};
+            for (int k = 0; k < n; ++k)
+            {
+                const auto& e = in[first + k];
+                c[0][k] = e.x;
+                c[1][k] = e.y;
+                c[2][k] = e.z;
+            }
+
+            auto x = vf::load(c[0]), y = vf::load(c[1]), z = vf::load(c[2]);
+
+            vf r[3];
+            for (int j = 0; j < 3; ++j)
+                r[j] = col[0][j]*x + col[1][j]*y + col[2][j]*z + col[3][j];
+
+            if(project)
+            {
+                auto rw = col[0][3]*x + col[1][3]*y + col[2][3]*z + col[3][3];
+                for (auto& rj: r)
+                    rj = rj/rw;
+            }
+
+            for (int j = 0; j < 3; ++j)
+                r[j].store(c[j]);
+
+            for (int k = 0; k < n; ++k)
+                out[first + k] = Out{c[0][k], c[1][k], c[2][k]};
+        }
+    }
+
+    void Transform::operator()(std::span<const Point3> in, std::span<Point3> out) const
+    {
+        transform_batch(transform, in, out, 1.f);
+    }
+
+    void Transform::operator()(std::span<const Vec3> in, std::span<Vec3> out) const
+    {
+        transform_batch(transform, in, out, 0.f);
+    }
+
+    void Transform::operator()(std::span<const Normal> in, std::span<Normal> out) const
+    {
+        transform_batch(Mat4{normal_matrix}, in, out, 0.f);
+    }
 }
\ No newline at end of file
@@ -1,10 +1,13 @@
 
 #pragma once
 
+#include "Core.hpp"
 #include "Utils/Math/geometry.hpp"
 #include "Utils/Interaction.hpp"
 #include "Objects/Bounds.hpp"
 
+#include <span>
+
 namespace Ilya
 {
     enum class Axis
@@ -16,13 +19,15 @@ namespace Ilya
     ///
     /// Transformation as described by a 4x4 matrix
     /// in homogeneous coordinates. Contains inverse
-    /// as well to speed up calculations.
+    /// as well to speed up calculations, and the
+    /// matrix transforming the normals.
     class Transform
     {
         public:
 
             Transform(const Mat4& transform, const Mat4& inverse):
-                transform(transform), inv(inverse) {}
+                transform(transform), inv(inverse),
+                normal_matrix(transpose(Mat3{inverse})) {}
 
             explicit Transform(const Mat4& transform):
                 Transform(transform, glm::inverse(transform))
@@ -34,9 +39,24 @@ namespace Ilya
             Point3 operator()(const Point3& p) const;
             Normal operator()(const Normal& n) const;
             Bounds operator()(const Bounds& b) const;
+            Ray operator()(const Ray& r) const;
+            SurfaceInteraction operator()(const SurfaceInteraction& si) const;
+
+            /// Batch versions of the operators above: transform
+            /// the elements of `in` into `out` (which can be
+            /// the same array), several at a time with SIMD
+            /// instructions, for instance the vertices of a
+            /// mesh or the corners of a box.
+            void operator()(std::span<const Point3> in, std::span<Point3> out) const;
+            void operator()(std::span<const Vec3> in, std::span<Vec3> out) const;
+            void operator()(std::span<const Normal> in, std::span<Normal> out) const;
 
             Mat4 transform;
             Mat4 inv;
+
+            /// Inverse transpose of the upper-left 3x3 part
+            /// of `transform` (see the `Normal` operator).
+            Mat3 normal_matrix;
     };
 
     Transform operator*(const Transform& t1, const Transform& t2);
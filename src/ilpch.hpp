@@ -16,7 +16,10 @@
 #include <fmt/color.h>
 #include <fmt/os.h>
 
+#include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x3.hpp>
 #include <glm/mat4x4.hpp>
 #include <glm/gtx/transform.hpp>
\ No newline at end of file